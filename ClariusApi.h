@@ -1,5 +1,12 @@
+#pragma once
+
+#include "ClariusFramePool.h"
+#include "ClariusGrayIngest.h"
+#include "ClariusOrderedWorkerPool.h"
+
 #include <ImFusion/Core/Mat.h>
 
+#include <atomic>
 #include <functional>
 #include <memory>
 
@@ -9,9 +16,84 @@ namespace ImFusion
 	template <typename T>
 	class TypedImage;
 
+	/// Pre-scan-converted frame as delivered by the raw data callback
+	struct ClariusRawFrame
+	{
+		ClariusFramePool::Buffer data;      ///< Line-major samples (lines x samples), or the JPEG payload if jpegSize > 0
+		int lines = 0;                      ///< Number of ultrasound lines
+		int samples = 0;                    ///< Number of samples per line
+		int bitsPerSample = 0;              ///< Bits per sample
+		double axialSize = 0.0;             ///< Axial microns per sample
+		double lateralSize = 0.0;           ///< Lateral microns per line
+		unsigned long long timestamp = 0;   ///< Device timestamp in nanoseconds
+		int jpegSize = 0;                   ///< Size of the JPEG payload, 0 if not compressed
+		bool rf = false;                    ///< True if the data is RF and not envelope
+	};
+
+	/// Block of spectral (M-mode or PW Doppler) lines as delivered by the spectral image callback
+	struct ClariusSpectralBlock
+	{
+		ClariusFramePool::Buffer data;      ///< Line-major samples (lines x samples)
+		int lines = 0;                      ///< Number of lines in the block
+		int samples = 0;                    ///< Number of samples per line
+		int bitsPerSample = 0;              ///< Bits per sample
+		double period = 0.0;                ///< Line acquisition period in seconds
+		double micronsPerSample = 0.0;      ///< Microns per sample in an M spectrum
+		double velocityPerSample = 0.0;     ///< Velocity in m/s per sample in a PW spectrum
+		bool pw = false;                    ///< True if the data is PW and not M
+	};
+
+	/// Colour Doppler or strain overlay sent separately from the grayscale frame, see ClariusApi::setSeparateOverlays()
+	struct ClariusOverlayFrame
+	{
+		std::unique_ptr<TypedImage<unsigned char>> image;    ///< Full frame overlay, transparent outside the coloured region
+		unsigned long long timestamp = 0;                    ///< Device timestamp in nanoseconds, equal to the one of the grayscale frame
+	};
+
+	/// Single IMU sample as delivered by the IMU callback
+	struct ClariusImuSample
+	{
+		unsigned long long timestamp = 0;          ///< Device timestamp in nanoseconds
+		vec3 gyro = vec3::Zero();                  ///< Angular velocity in radians per second
+		vec3 linAcc = vec3::Zero();                ///< Acceleration normalized to gravity
+		vec3 mag = vec3::Zero();                   ///< Magnetic flux density normalized to the earth's field
+		quat orientation = quat::Identity();       ///< Orientation estimated by the probe
+	};
+
+	/// Imaging information of a processed frame
+	struct ClariusImageInfo
+	{
+		double micronsPerPixel = 0.0;    ///< Pixel size in microns, equal in both directions
+		double originX = 0.0;            ///< Horizontal position of the center of the probe face in microns from the left image border
+		double originY = 0.0;            ///< Vertical position of the center of the probe face in microns from the top image border
+		std::shared_ptr<const TypedImage<unsigned char>> mask;    ///< Alpha channel of an ARGB frame converted to gray on ingest, see ClariusApi::setConvertToGray()
+		unsigned int maskSignature = 0;                           ///< ClariusKernels::alphaSignature() of the frame if mask is set
+	};
+
+	/// Probe information as reported by the Cast SDK
+	struct ClariusProbeInfo
+	{
+		int version = 0;     ///< Probe generation (1 = first generation, 2 = HD, 3 = HD3)
+		int elements = 0;    ///< Number of probe elements
+		int pitch = 0;       ///< Element pitch in microns
+		int radius = 0;      ///< Radius in millimeters, 0 for linear arrays
+		std::string firmware;    ///< Firmware version of the probe platform, empty if unknown
+	};
+
 	class ClariusApi
 	{
 	public:
+		/// Image formats the probe can transmit, values correspond to CusImageFormat
+		enum class ImageFormat
+		{
+			Argb = 0,     ///< Uncompressed 32-bit ARGB (default)
+			Gray8 = 1,    ///< Uncompressed 8-bit grayscale
+			Jpeg = 2,     ///< JPEG compressed, decoded on the host
+			Png = 3       ///< PNG compressed, decoded on the host
+		};
+
+		virtual ~ClariusApi() = default;
+
 		virtual bool init() = 0;
 		virtual bool connect(const char* ipAddress, unsigned int port) = 0;
 		virtual void disconnect() = 0;
@@ -28,12 +110,57 @@ namespace ImFusion
 		/// Set resolution (width, height)
 		virtual bool setResolution(vec2i resolution) = 0;
 
+		/// Set the format of processed images, must be called after init()
+		/// Compressed formats are decoded by a pool of numDecodeThreads workers, preserving the frame order.
+		virtual bool setImageFormat(ImageFormat format, int numDecodeThreads = 2) { return format == ImageFormat::Argb; }
+
+		/// Enables sending colour Doppler and strain overlays separately from the grayscale image, must be called after init()
+		/// Overlays are then delivered through overlayCallback instead of being blended into the frames of imageCallback.
+		virtual bool setSeparateOverlays(bool enable) { return !enable; }
+
+		/// Converts colour frames to grayscale while copying them from the SDK, instead of handing over ARGB images
+		/// The alpha channel of uncompressed ARGB frames is then passed on as ClariusImageInfo::mask. Separately sent
+		/// overlays keep their colours.
+		void setConvertToGray(bool enable) { m_convertToGray = enable; }
+
+		/// Timing statistics of decoding compressed frames
+		virtual ClariusWorkerPoolStats decodeStats() const { return {}; }
+
+		/// Retrieves information about the connected probe
+		virtual bool probeInfo(ClariusProbeInfo& info) { return false; }
+
+		/// Pool providing the frame buffers handed to imageCallback
+		ClariusFramePool& framePool() { return m_framePool; }
+
 		std::function<void(std::unique_ptr<TypedImage<unsigned char>>&& frame, unsigned long long timestamp, std::unique_ptr<IMURawMetadata>&& imu)>
 			imageCallback = {};
 
+		/// Called with every overlay if separate overlays are enabled, the image comes from framePool()
+		std::function<void(ClariusOverlayFrame&& overlay)> overlayCallback = {};
+
+		/// Called on the SDK thread with a copy of every raw frame, the frame data comes from framePool()
+		std::function<void(ClariusRawFrame&& frame)> rawImageCallback = {};
+
+		/// Called on the SDK thread with a copy of every spectral block, the block data comes from framePool()
+		std::function<void(ClariusSpectralBlock&& block)> spectralImageCallback = {};
+
+		/// Called on the SDK thread for every standalone IMU sample, must not block
+		std::function<void(const ClariusImuSample& sample)> imuCallback = {};
+
+		/// Called on the SDK thread with the IMU samples bundled with a processed image, before imageCallback
+		std::function<void(const ClariusImuSample* samples, int count)> imageImuCallback = {};
+
+		/// Called with the imaging information of every processed image, on the same thread immediately before imageCallback
+		std::function<void(const ClariusImageInfo& info)> imageInfoCallback = {};
+
 		std::function<void(double depth, double width)> measuresCallback = {};
 		std::function<void(bool frozen)> freezeCallback = {};
 		std::function<void(int btn, int clicks)> buttonCallback = {};
+
+	protected:
+		ClariusFramePool m_framePool;
+		std::atomic<bool> m_convertToGray = {false};
+		ClariusGrayIngest m_grayIngest;    ///< Converts uncompressed ARGB frames, only used on the SDK thread
 	};
 
 	class ClariusCastApi : public ClariusApi
@@ -50,9 +177,16 @@ namespace ImFusion
 		bool setGain(double gain) override;
 		bool setDepth(double depth) override;
 		bool setResolution(vec2i resolution) override;
+		bool setImageFormat(ImageFormat format, int numDecodeThreads = 2) override;
+		bool setSeparateOverlays(bool enable) override;
+		ClariusWorkerPoolStats decodeStats() const override;
+		bool probeInfo(ClariusProbeInfo& info) override;
 
 	private:
 		ClariusCastApi();
 		static ClariusCastApi* m_singletonCastApiInstance;
+
+		struct DecodePool;
+		std::unique_ptr<DecodePool> m_decodePool;    ///< Decodes JPEG/PNG frames, only present for compressed transport
 	};
 }
\ No newline at end of file
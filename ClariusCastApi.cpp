@@ -1,4 +1,5 @@
 #include "ClariusApi.h"
+#include "ClariusKernels.h"
 
 #include <ImFusion/Base/IMUPoseIntegration.h>
 #include <ImFusion/Base/ImageProcessing.h>
@@ -16,9 +17,126 @@
 #include <cast/cast.h>
 
 #include <QDir>
+#include <QImage>
 
 namespace ImFusion
 {
+	namespace
+	{
+		/// Compressed frame as received from the SDK, waiting to be decoded
+		struct EncodedFrame
+		{
+			ClariusFramePool::Buffer payload;
+			int size = 0;
+			bool png = false;
+			ClariusImageInfo info;
+			unsigned long long timestamp = 0;
+			std::unique_ptr<IMURawMetadata> imu;
+			bool overlay = false;
+			bool gray = false;    ///< Convert to grayscale while copying out of the decoded image
+		};
+
+		/// Decoded frame, ready to be handed to the image or overlay callback
+		struct DecodedFrame
+		{
+			std::unique_ptr<TypedImage<unsigned char>> img;
+			ClariusImageInfo info;
+			unsigned long long timestamp = 0;
+			std::unique_ptr<IMURawMetadata> imu;
+			bool overlay = false;
+		};
+
+		/// Hands an image to the overlay callback if it is a separately sent overlay, returns false otherwise
+		bool deliverOverlay(ClariusApi& api, std::unique_ptr<TypedImage<unsigned char>>& img, unsigned long long timestamp, bool overlay)
+		{
+			if (!overlay)
+				return false;
+			if (api.overlayCallback)
+			{
+				ClariusOverlayFrame frame;
+				frame.image = std::move(img);
+				frame.timestamp = timestamp;
+				api.overlayCallback(std::move(frame));
+			}
+			return true;
+		}
+
+		ClariusImageInfo imageInfo(const CusProcessedImageInfo& nfo)
+		{
+			ClariusImageInfo info;
+			info.micronsPerPixel = nfo.micronsPerPixel;
+			info.originX = nfo.originX;
+			info.originY = nfo.originY;
+			return info;
+		}
+
+		/// Hands a grayscale frame and its imaging information to the image callbacks
+		void deliverImage(ClariusApi& api, std::unique_ptr<TypedImage<unsigned char>>& img, const ClariusImageInfo& info, unsigned long long timestamp,
+						  std::unique_ptr<IMURawMetadata>& imu)
+		{
+			if (api.imageInfoCallback)
+				api.imageInfoCallback(info);
+			api.imageCallback(std::move(img), timestamp, std::move(imu));
+		}
+	}
+
+
+	struct ClariusCastApi::DecodePool
+	{
+		DecodePool(ClariusFramePool& framePool, int numThreads)
+			: pool(
+				  numThreads,
+				  2 * numThreads + 2,
+				  [&framePool](EncodedFrame&& in) { return decode(framePool, std::move(in)); },
+				  [](DecodedFrame&& out) {
+					  if (!out.img || !m_singletonCastApiInstance)
+						  return;
+					  if (!deliverOverlay(*m_singletonCastApiInstance, out.img, out.timestamp, out.overlay))
+						  deliverImage(*m_singletonCastApiInstance, out.img, out.info, out.timestamp, out.imu);
+				  })
+		{
+		}
+
+		static DecodedFrame decode(ClariusFramePool& framePool, EncodedFrame&& in)
+		{
+			DecodedFrame out;
+			out.timestamp = in.timestamp;
+			out.info = in.info;
+			out.imu = std::move(in.imu);
+			out.overlay = in.overlay;
+
+			QImage decoded;
+			if (!decoded.loadFromData(in.payload.data(), in.size, in.png ? "PNG" : "JPG"))
+			{
+				LOG_WARN("Could not decode compressed Clarius frame");
+				return out;
+			}
+			in.payload.release();    // give the payload back as early as possible
+
+			// QImage::Format_ARGB32 has the same memory layout as the uncompressed ARGB transport
+			if (decoded.format() != QImage::Format_ARGB32)
+				decoded = decoded.convertToFormat(QImage::Format_ARGB32);
+
+			const int width = decoded.width();
+			const int height = decoded.height();
+			const int channels = in.gray ? 1 : 4;
+			out.img = framePool.acquireImage<unsigned char>(width, height, channels);
+			for (int y = 0; y < height; y++)
+			{
+				unsigned char* row = out.img->pointer() + static_cast<size_t>(y) * width * channels;
+				if (in.gray)
+					ClariusKernels::argbToGray(decoded.constScanLine(y), width, row, nullptr);    // compressed frames carry no mask
+				else
+					memcpy(row, decoded.constScanLine(y), static_cast<size_t>(width) * 4);
+			}
+			out.img->setSpacing(in.info.micronsPerPixel * 1.e-3, in.info.micronsPerPixel * 1.e-3, 1., true);
+			return out;
+		}
+
+		ClariusOrderedWorkerPool<EncodedFrame, DecodedFrame> pool;
+	};
+
+
 	ClariusCastApi* ClariusCastApi::m_singletonCastApiInstance = nullptr;
 
 	ClariusCastApi* ClariusCastApi::get()
@@ -42,15 +160,25 @@ namespace ImFusion
 			[](const void* newImage, const CusProcessedImageInfo* nfo, int npos, const CusPosInfo* pos) {
 				try
 				{
-					if (!nfo)
+					if (!nfo || !m_singletonCastApiInstance)
 						return;
-					const int channels = nfo->bitsPerPixel / 8;
-					ImageDescriptor desc(PixelType::UByte, vec3i(nfo->width, nfo->height, 1), channels);
-					auto img = TypedImage<unsigned char>::create(desc);
-					memcpy(img->data(), newImage, sizeof(unsigned char) * nfo->width * nfo->height * channels);
-					img->setSpacing(nfo->micronsPerPixel * 1.e-3, nfo->micronsPerPixel * 1.e-3, 1., true);
 
 					std::unique_ptr<IMURawMetadata> imuMetadata;
+					if (npos > 0 && pos && m_singletonCastApiInstance->imageImuCallback)
+					{
+						// IMURawMetadata has no orientation, so the full samples are handed over separately
+						thread_local std::vector<ClariusImuSample> samples;
+						samples.resize(npos);
+						for (int i = 0; i < npos; i++)
+						{
+							samples[i].timestamp = static_cast<unsigned long long>(pos[i].tm);
+							samples[i].gyro = vec3(pos[i].gx, pos[i].gy, pos[i].gz);
+							samples[i].linAcc = vec3(pos[i].ax, pos[i].ay, pos[i].az);
+							samples[i].mag = vec3(pos[i].mx, pos[i].my, pos[i].mz);
+							samples[i].orientation = quat(pos[i].qw, pos[i].qx, pos[i].qy, pos[i].qz);
+						}
+						m_singletonCastApiInstance->imageImuCallback(samples.data(), npos);
+					}
 					if (npos > 0 && pos)
 					{
 						imuMetadata = std::make_unique<IMURawMetadata>();
@@ -64,9 +192,47 @@ namespace ImFusion
 						}
 					}
 
-					if (m_singletonCastApiInstance)
-						m_singletonCastApiInstance->imageCallback(
-							std::move(img), static_cast<unsigned long long>(nfo->tm), std::move(imuMetadata));
+					const bool compressed = nfo->format == CusImageFormat::Jpeg || nfo->format == CusImageFormat::Png;
+					if (compressed)
+					{
+						// only copy the payload here, decoding happens on the decode pool
+						if (!m_singletonCastApiInstance->m_decodePool || nfo->imageSize <= 0)
+							return;
+						EncodedFrame frame;
+						frame.payload = m_singletonCastApiInstance->framePool().acquireBytes(nfo->imageSize);
+						memcpy(frame.payload.data(), newImage, nfo->imageSize);
+						frame.size = nfo->imageSize;
+						frame.png = nfo->format == CusImageFormat::Png;
+						frame.info = imageInfo(*nfo);
+						frame.timestamp = static_cast<unsigned long long>(nfo->tm);
+						frame.imu = std::move(imuMetadata);
+						frame.overlay = nfo->overlay != 0;
+						frame.gray = m_singletonCastApiInstance->m_convertToGray && !frame.overlay;
+						if (!m_singletonCastApiInstance->m_decodePool->pool.submit(std::move(frame)))
+							LOG_WARN("Clarius decode pool saturated, dropping frame");
+						return;
+					}
+
+					const int channels = nfo->bitsPerPixel / 8;
+					ClariusImageInfo info = imageInfo(*nfo);
+					std::unique_ptr<TypedImage<unsigned char>> img;
+					if (channels == 4 && nfo->overlay == 0 && m_singletonCastApiInstance->m_convertToGray)
+					{
+						// single pass from the SDK buffer to a grayscale frame, instead of copying and converting later
+						img = m_singletonCastApiInstance->m_grayIngest.convert(
+							m_singletonCastApiInstance->framePool(), static_cast<const uint8_t*>(newImage), nfo->width, nfo->height, info);
+					}
+					else
+					{
+						// pooled buffer, returned to the pool once the last reference to the frame is gone
+						img = m_singletonCastApiInstance->framePool().acquireImage<unsigned char>(nfo->width, nfo->height, channels);
+						memcpy(img->data(), newImage, sizeof(unsigned char) * nfo->width * nfo->height * channels);
+						img->setSpacing(nfo->micronsPerPixel * 1.e-3, nfo->micronsPerPixel * 1.e-3, 1., true);
+					}
+
+					const auto timestamp = static_cast<unsigned long long>(nfo->tm);
+					if (!deliverOverlay(*m_singletonCastApiInstance, img, timestamp, nfo->overlay != 0))
+						deliverImage(*m_singletonCastApiInstance, img, info, timestamp, imuMetadata);
 				}
 				catch (...)
 				{
@@ -74,15 +240,88 @@ namespace ImFusion
 				}
 			},
 			// New raw image function callback
-				[](const void* /*newImage*/, const CusRawImageInfo* nfo, int /*npos*/, const CusPosInfo* /*pos*/) {
+				[](const void* newImage, const CusRawImageInfo* nfo, int /*npos*/, const CusPosInfo* /*pos*/) {
 				double measuredDepth = std::floor((nfo->samples * nfo->axialSize) * 1e-3);
 				if (m_singletonCastApiInstance)
 					m_singletonCastApiInstance->measuresCallback(measuredDepth, nfo->lines * nfo->lateralSize * 1e-3);
+
+				if (!m_singletonCastApiInstance || !m_singletonCastApiInstance->rawImageCallback || !newImage)
+					return;
+				try
+				{
+					// copy into a pooled buffer, everything else happens asynchronously in the consumer
+					ClariusRawFrame frame;
+					frame.lines = nfo->lines;
+					frame.samples = nfo->samples;
+					frame.bitsPerSample = nfo->bitsPerSample;
+					frame.axialSize = nfo->axialSize;
+					frame.lateralSize = nfo->lateralSize;
+					frame.timestamp = static_cast<unsigned long long>(nfo->tm);
+					frame.jpegSize = nfo->jpeg;
+					frame.rf = nfo->rf != 0;
+					if (frame.jpegSize > 0)
+					{
+						frame.data = m_singletonCastApiInstance->framePool().acquireBytes(frame.jpegSize);
+						memcpy(frame.data.data(), newImage, frame.jpegSize);
+					}
+					else
+					{
+						ClariusFramePool::Key key;
+						key.width = nfo->samples;
+						key.height = nfo->lines;
+						key.channels = 1;
+						key.bytesPerChannel = std::max(nfo->bitsPerSample / 8, 1);
+						frame.data = m_singletonCastApiInstance->framePool().acquire(key);
+						memcpy(frame.data.data(), newImage, key.byteSize());
+					}
+					m_singletonCastApiInstance->rawImageCallback(std::move(frame));
+				}
+				catch (...)
+				{
+					LOG_ERROR("Undefined error in new raw image function callback.");
+				}
 			},
 				// New spectral image function callback
-				[](const void* /*newImage*/, const CusSpectralImageInfo* /*nfo*/) {},
+				[](const void* newImage, const CusSpectralImageInfo* nfo) {
+				if (!nfo || !newImage || !m_singletonCastApiInstance || !m_singletonCastApiInstance->spectralImageCallback)
+					return;
+				try
+				{
+					ClariusSpectralBlock block;
+					block.lines = nfo->lines;
+					block.samples = nfo->samples;
+					block.bitsPerSample = nfo->bitsPerSample;
+					block.period = nfo->period;
+					block.micronsPerSample = nfo->micronsPerSample;
+					block.velocityPerSample = nfo->velocityPerSample;
+					block.pw = nfo->pw != 0;
+
+					ClariusFramePool::Key key;
+					key.width = nfo->samples;
+					key.height = nfo->lines;
+					key.channels = 1;
+					key.bytesPerChannel = std::max(nfo->bitsPerSample / 8, 1);
+					block.data = m_singletonCastApiInstance->framePool().acquire(key);
+					memcpy(block.data.data(), newImage, key.byteSize());
+					m_singletonCastApiInstance->spectralImageCallback(std::move(block));
+				}
+				catch (...)
+				{
+					LOG_ERROR("Undefined error in new spectral image function callback.");
+				}
+			},
 				// New IMU data callback
-				[](const CusPosInfo* pos) {},
+				[](const CusPosInfo* pos) {
+				if (!pos || !m_singletonCastApiInstance || !m_singletonCastApiInstance->imuCallback)
+					return;
+				ClariusImuSample sample;
+				sample.timestamp = static_cast<unsigned long long>(pos->tm);
+				sample.gyro = vec3(pos->gx, pos->gy, pos->gz);
+				sample.linAcc = vec3(pos->ax, pos->ay, pos->az);
+				sample.mag = vec3(pos->mx, pos->my, pos->mz);
+				sample.orientation = quat(pos->qw, pos->qx, pos->qy, pos->qz);
+				m_singletonCastApiInstance->imuCallback(sample);
+			},
 				// Freeze / unfreeze function callback
 				[](int val) {
 				if (m_singletonCastApiInstance)
@@ -130,6 +369,7 @@ namespace ImFusion
 	void ClariusCastApi::destroy()
 	{
 		cusCastDestroy();
+		m_decodePool.reset();
 	}
 
 	bool ClariusCastApi::setGain(double gain) { return cusCastUserFunction(CusUserFunction::SetGain, gain / 100.0 - 0.5, nullptr) >= 0; }
@@ -138,5 +378,54 @@ namespace ImFusion
 
 	bool ClariusCastApi::setResolution(vec2i resolution) { return cusCastSetOutputSize(resolution[0], resolution[1]) >= 0; }
 
+	bool ClariusCastApi::setImageFormat(ImageFormat format, int numDecodeThreads)
+	{
+		CusImageFormat castFormat = CusImageFormat::Uncompressed;
+		switch (format)
+		{
+			case ImageFormat::Argb:
+				castFormat = CusImageFormat::Uncompressed;
+				break;
+			case ImageFormat::Gray8:
+				castFormat = CusImageFormat::Uncompressed8Bit;
+				break;
+			case ImageFormat::Jpeg:
+				castFormat = CusImageFormat::Jpeg;
+				break;
+			case ImageFormat::Png:
+				castFormat = CusImageFormat::Png;
+				break;
+			default:
+				return false;
+		}
+
+		const bool compressed = format == ImageFormat::Jpeg || format == ImageFormat::Png;
+		if (compressed && (!m_decodePool || m_decodePool->pool.numWorkers() != numDecodeThreads))
+			m_decodePool = std::make_unique<DecodePool>(m_framePool, numDecodeThreads);
+		else if (!compressed)
+			m_decodePool.reset();
+
+		return cusCastSetFormat(castFormat) >= 0;
+	}
+
+	bool ClariusCastApi::setSeparateOverlays(bool enable) { return cusCastSeparateOverlays(enable ? 1 : 0) >= 0; }
+
+	ClariusWorkerPoolStats ClariusCastApi::decodeStats() const { return m_decodePool ? m_decodePool->pool.stats() : ClariusWorkerPoolStats(); }
+
+	bool ClariusCastApi::probeInfo(ClariusProbeInfo& info)
+	{
+		CusProbeInfo castInfo;
+		if (cusCastProbeInfo(&castInfo) < 0)
+			return false;
+		info.version = castInfo.version;
+		info.elements = castInfo.elements;
+		info.pitch = castInfo.pitch;
+		info.radius = castInfo.radius;
+		char firmware[64] = {};
+		if (castInfo.version >= 1 && cusCastFwVersion(static_cast<CusPlatform>(castInfo.version - 1), firmware, sizeof(firmware)) >= 0)
+			info.firmware = firmware;
+		return true;
+	}
+
 	bool ClariusCastApi::loadCertificate(const std::string& path) { return true; }
 }
\ No newline at end of file
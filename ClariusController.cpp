@@ -12,6 +12,7 @@
 
 #include <QPushButton>
 #include <QLabel>
+#include <QStringList>
 
 namespace ImFusion
 {
@@ -142,5 +143,47 @@ namespace ImFusion
 			m_fpsLabel->setText(QString("Resolution %1 x %2 px, FPS %3").arg(width).arg(height).arg(fps));
 		else
 			m_fpsLabel->clear();
+
+		auto pool = m_clariusStream->framePoolStats();
+		QString toolTip = QString("Frame buffers allocated: %1, recycled: %2, in use: %3").arg(pool.allocations).arg(pool.reuses).arg(pool.outstanding);
+		auto decode = m_clariusStream->decodeStats();
+		if (decode.submitted > 0)
+			toolTip += QString("\nDecode time: last %1 ms, mean %2 ms, max %3 ms, pending %4, dropped %5")
+						   .arg(decode.lastTaskMs, 0, 'f', 1)
+						   .arg(decode.meanTaskMs, 0, 'f', 1)
+						   .arg(decode.maxTaskMs, 0, 'f', 1)
+						   .arg(decode.pending)
+						   .arg(decode.dropped);
+		auto queue = m_clariusStream->queueStats();
+		toolTip += QString("\nFrame queue: depth %1 of %2, high-water %3, dropped %4")
+					   .arg(queue.depth)
+					   .arg(queue.capacity)
+					   .arg(queue.highWater)
+					   .arg(queue.droppedOldest + queue.droppedNewest + queue.superseded);
+		auto processing = m_clariusStream->processingStats();
+		if (processing.submitted > 0)
+		{
+			QStringList utilization;
+			for (double u : processing.workerUtilization)
+				utilization << QString("%1%").arg(100.0 * u, 0, 'f', 0);
+			toolTip += QString("\nProcessing threads: utilization %1, reorder wait mean %2 ms, max %3 ms")
+						   .arg(utilization.join(" "))
+						   .arg(processing.meanReorderWaitMs, 0, 'f', 1)
+						   .arg(processing.maxReorderWaitMs, 0, 'f', 1);
+		}
+		auto wakeup = m_clariusStream->wakeupStats();
+		if (wakeup.wakeups > 0)
+			toolTip += QString("\nProcessing wakeup: p50 %1 us, p99 %2 us, max %3 us")
+						   .arg(wakeup.p50Us, 0, 'f', 0)
+						   .arg(wakeup.p99Us, 0, 'f', 0)
+						   .arg(wakeup.maxUs, 0, 'f', 0);
+		auto geometry = m_clariusStream->geometryDetectionStats();
+		if (geometry.detections > 0)
+			toolTip += QString("\nGeometry detection: last %1 ms, max %2 ms, failed %3, frames without geometry %4")
+						   .arg(geometry.lastMs, 0, 'f', 1)
+						   .arg(geometry.maxMs, 0, 'f', 1)
+						   .arg(geometry.failed)
+						   .arg(m_clariusStream->numFramesWithoutGeometry());
+		m_fpsLabel->setToolTip(toolTip);
 	}
 }
@@ -0,0 +1,130 @@
+#include "ClariusFrame.h"
+
+#include "ClariusKernels.h"
+
+#include <ImFusion/Base/TypedImage.h>
+#include <ImFusion/GL/SharedImage.h>
+
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace ImFusion
+{
+	struct ClariusFrame::Views
+	{
+		std::shared_ptr<SharedImage> original;
+		ClariusGeometry::PixelRect sectorRect;
+		std::shared_ptr<const US::FrameGeometry> sectorGeometry;
+
+		std::once_flag grayOnce;
+		std::shared_ptr<SharedImage> gray;
+		std::once_flag sectorOnce;
+		std::shared_ptr<SharedImage> sector;
+
+		std::mutex previewMutex;    ///< Protects previews
+		std::vector<std::pair<int, std::shared_ptr<SharedImage>>> previews;
+	};
+
+
+	ClariusFrame::ClariusFrame(std::shared_ptr<SharedImage> original,
+							   const ClariusGeometry::PixelRect& sector,
+							   std::shared_ptr<const US::FrameGeometry> sectorGeometry,
+							   std::shared_ptr<SharedImage> sectorImage)
+		: m_views(std::make_shared<Views>())
+	{
+		m_views->original = std::move(original);
+		m_views->sectorRect = sector;
+		m_views->sectorGeometry = std::move(sectorGeometry);
+		if (sectorImage)
+			std::call_once(m_views->sectorOnce, [&] { m_views->sector = std::move(sectorImage); });
+	}
+
+
+	std::shared_ptr<SharedImage> ClariusFrame::original() const { return m_views ? m_views->original : nullptr; }
+
+
+	std::shared_ptr<SharedImage> ClariusFrame::gray() const
+	{
+		if (!m_views || !m_views->original)
+			return nullptr;
+		std::call_once(m_views->grayOnce, [this] {
+			auto* argb = dynamic_cast<const TypedImage<unsigned char>*>(m_views->original->mem());
+			if (!argb || argb->channels() != 4)
+			{
+				m_views->gray = m_views->original;
+				return;
+			}
+			auto gray = TypedImage<unsigned char>::create(vec3i(argb->width(), argb->height(), 1), 1);
+			gray->setSpacing(argb->spacing(), true);
+			ClariusKernels::argbToGray(argb->pointer(), static_cast<size_t>(argb->width()) * argb->height(), gray->pointer(), nullptr);
+			m_views->gray = std::make_shared<SharedImage>(std::move(gray));
+			m_views->gray->setMatrix(m_views->original->matrix());
+		});
+		return m_views->gray;
+	}
+
+
+	std::shared_ptr<SharedImage> ClariusFrame::sector() const
+	{
+		if (!m_views || !m_views->original)
+			return nullptr;
+		std::call_once(m_views->sectorOnce, [this] {
+			auto* img = dynamic_cast<const TypedImage<unsigned char>*>(m_views->original->mem());
+			const ClariusGeometry::PixelRect& rect = m_views->sectorRect;
+			if (!img || rect.size[0] <= 0 || rect.size[1] <= 0 || rect.origin[0] + rect.size[0] > img->width() ||
+				rect.origin[1] + rect.size[1] > img->height())
+			{
+				m_views->sector = m_views->original;
+				return;
+			}
+			auto cropped = TypedImage<unsigned char>::create(vec3i(rect.size[0], rect.size[1], 1), img->channels());
+			cropped->setSpacing(img->spacing(), true);
+			ClariusKernels::copyRect(img->pointer(), img->width(), img->channels(), rect.origin[0], rect.origin[1], rect.size[0], rect.size[1], cropped->pointer());
+
+			// the image center moved with the crop, the pixels keep their place in the world
+			const vec2 shift = (rect.origin.cast<double>() + 0.5 * rect.size.cast<double>() - 0.5 * vec2(img->width(), img->height())) * img->spacing().x();
+			mat4 matrix = m_views->original->matrix();
+			matrix.block<2, 1>(0, 3) -= shift;
+			m_views->sector = std::make_shared<SharedImage>(std::move(cropped));
+			m_views->sector->setMatrix(matrix);
+		});
+		return m_views->sector;
+	}
+
+
+	std::shared_ptr<const US::FrameGeometry> ClariusFrame::sectorGeometry() const { return m_views ? m_views->sectorGeometry : nullptr; }
+
+
+	std::shared_ptr<SharedImage> ClariusFrame::preview(int factor) const
+	{
+		if (factor < 2)
+			return gray();
+		auto source = gray();
+		if (!source)
+			return nullptr;
+
+		// the lock is held during the computation, so concurrent requests for the same factor compute it only once
+		std::lock_guard<std::mutex> lock(m_views->previewMutex);
+		for (const auto& entry : m_views->previews)
+			if (entry.first == factor)
+				return entry.second;
+
+		auto* img = dynamic_cast<const TypedImage<unsigned char>*>(source->mem());
+		if (!img || img->width() < factor || img->height() < factor)
+			return source;
+		const vec3 spacing = img->spacing();
+		auto reduced = TypedImage<unsigned char>::create(vec3i(img->width() / factor, img->height() / factor, 1), 1);
+		reduced->setSpacing(vec3(spacing.x() * factor, spacing.y() * factor, spacing.z()), true);
+		ClariusKernels::boxDownsample(img->pointer(), img->width(), img->height(), factor, reduced->pointer());
+
+		// rows and columns not filling a whole block are dropped, which moves the image center
+		mat4 matrix = source->matrix();
+		matrix(0, 3) -= 0.5 * (reduced->width() * factor - img->width()) * spacing.x();
+		matrix(1, 3) -= 0.5 * (reduced->height() * factor - img->height()) * spacing.y();
+		auto preview = std::make_shared<SharedImage>(std::move(reduced));
+		preview->setMatrix(matrix);
+		m_views->previews.emplace_back(factor, preview);
+		return preview;
+	}
+}
@@ -0,0 +1,62 @@
+/* Copyright (c) 2012-2019 ImFusion GmbH, Munich, Germany. All rights reserved. */
+#pragma once
+
+#include "ClariusGeometry.h"
+
+#include <ImFusion/Base/Data.h>
+
+#include <memory>
+
+namespace ImFusion
+{
+	class SharedImage;
+
+	namespace US
+	{
+		class FrameGeometry;
+	}
+
+	/**	\brief	Data component giving access to the pixels of a frame as received and to representations derived from them
+	 *
+	 *	Derived views are computed on first access, at most once per frame even if several consumers ask for them at
+	 *	the same time, and are kept until the last copy of the component is gone. Copies share the original pixels
+	 *	and all views, so a consumer only pays for the representations it actually reads. The component is attached to
+	 *	every frame of a ClariusStream with p_frameViews set; the frame's own image may differ from original() if the
+	 *	stream converts or crops it eagerly.
+	 */
+	class ClariusFrame : public DataComponent<ClariusFrame>
+	{
+	public:
+		ClariusFrame() = default;
+
+		/// Creates the component for an 8-bit ARGB (BGRA in memory) or grayscale frame
+		/// The field of view is the sector rectangle with its geometry, an empty rectangle if it is not known. An already
+		/// computed crop of the original to that rectangle can be handed over as sectorImage.
+		ClariusFrame(std::shared_ptr<SharedImage> original,
+					 const ClariusGeometry::PixelRect& sector,
+					 std::shared_ptr<const US::FrameGeometry> sectorGeometry,
+					 std::shared_ptr<SharedImage> sectorImage = nullptr);
+
+		std::string id() const override { return "ClariusFrame"; }
+
+		/// Pixels as received from the probe, null for a default constructed component
+		std::shared_ptr<SharedImage> original() const;
+
+		/// Grayscale version of the original, the original itself if it has a single channel
+		std::shared_ptr<SharedImage> gray() const;
+
+		/// Original cropped to the bounding box of the field of view, the original itself if that is not known
+		std::shared_ptr<SharedImage> sector() const;
+
+		/// Frame geometry of sector(), null if not known
+		std::shared_ptr<const US::FrameGeometry> sectorGeometry() const;
+
+		/// Grayscale version reduced by the given factor in both directions by averaging blocks of pixels
+		/// Factors below 2 return gray(). Each factor is computed once per frame.
+		std::shared_ptr<SharedImage> preview(int factor) const;
+
+	private:
+		struct Views;
+		std::shared_ptr<Views> m_views;
+	};
+}
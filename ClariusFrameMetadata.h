@@ -0,0 +1,58 @@
+/* Copyright (c) 2012-2019 ImFusion GmbH, Munich, Germany. All rights reserved. */
+#pragma once
+
+#include <ImFusion/Base/Data.h>
+
+#include <cstdint>
+#include <memory>
+
+namespace ImFusion
+{
+	namespace US
+	{
+		class FrameGeometry;
+		class UltrasoundMetadata;
+	}
+
+	/// Immutable description of the imaging configuration, shared by all frames acquired with it
+	struct ClariusFrameSnapshot
+	{
+		uint64_t version = 0;                                         ///< Increases with every change, equal versions have equal content
+		std::shared_ptr<const US::FrameGeometry> geometry;           ///< Frame geometry, null if not known
+		std::shared_ptr<const US::UltrasoundMetadata> ultrasound;    ///< Device, probe and depth information
+	};
+
+
+	/**	\brief	Data component attaching the shared imaging configuration to a frame
+	 *
+	 *	The snapshot is only rebuilt when the configuration changes, so attaching it to a frame or copying the component
+	 *	just increments a reference count. Consumers can detect changes by comparing version() with the one of the
+	 *	previous frame instead of comparing geometries.
+	 */
+	class ClariusFrameMetadata : public DataComponent<ClariusFrameMetadata>
+	{
+	public:
+		ClariusFrameMetadata() = default;
+		explicit ClariusFrameMetadata(std::shared_ptr<const ClariusFrameSnapshot> snapshot)
+			: m_snapshot(std::move(snapshot))
+		{
+		}
+
+		std::string id() const override { return "ClariusFrameMetadata"; }
+
+		/// Shared snapshot, null for a default constructed component
+		const std::shared_ptr<const ClariusFrameSnapshot>& snapshot() const { return m_snapshot; }
+
+		/// Version of the snapshot, 0 if there is none
+		uint64_t version() const { return m_snapshot ? m_snapshot->version : 0; }
+
+		/// Frame geometry, null if not known
+		const US::FrameGeometry* geometry() const { return m_snapshot ? m_snapshot->geometry.get() : nullptr; }
+
+		/// Ultrasound metadata, null if there is no snapshot
+		const US::UltrasoundMetadata* ultrasound() const { return m_snapshot ? m_snapshot->ultrasound.get() : nullptr; }
+
+	private:
+		std::shared_ptr<const ClariusFrameSnapshot> m_snapshot;
+	};
+}
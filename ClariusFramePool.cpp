@@ -0,0 +1,174 @@
+#include "ClariusFramePool.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <new>
+#include <tuple>
+#include <vector>
+
+namespace ImFusion
+{
+	struct ClariusFramePool::Buffer::State
+	{
+		explicit State(size_t maxIdle)
+			: maxIdlePerKey(maxIdle)
+		{
+		}
+
+		~State()
+		{
+			for (auto& entry : idle)
+				for (unsigned char* ptr : entry.second)
+					free(ptr);
+		}
+
+		unsigned char* allocate(const Key& key)
+		{
+			allocations++;
+			return static_cast<unsigned char*>(::operator new(std::max<size_t>(key.byteSize(), 1), std::align_val_t(ClariusFramePool::alignment())));
+		}
+
+		static void free(unsigned char* ptr) { ::operator delete(ptr, std::align_val_t(ClariusFramePool::alignment())); }
+
+		void recycle(const Key& key, unsigned char* ptr)
+		{
+			outstanding--;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				auto& list = idle[key];
+				if (list.size() < maxIdlePerKey)
+				{
+					list.push_back(ptr);    // capacity has been reserved on first use of the key
+					return;
+				}
+			}
+			free(ptr);
+		}
+
+		const size_t maxIdlePerKey;
+		std::mutex mutex;                                             ///< Protects idle
+		std::map<Key, std::vector<unsigned char*>> idle;              ///< Idle buffers per key
+		std::atomic<size_t> allocations = {0};
+		std::atomic<size_t> reuses = {0};
+		std::atomic<size_t> outstanding = {0};
+	};
+
+
+	bool ClariusFramePool::Key::operator<(const Key& other) const
+	{
+		return std::tie(width, height, channels, bytesPerChannel) < std::tie(other.width, other.height, other.channels, other.bytesPerChannel);
+	}
+
+
+	bool ClariusFramePool::Key::operator==(const Key& other) const
+	{
+		return std::tie(width, height, channels, bytesPerChannel) == std::tie(other.width, other.height, other.channels, other.bytesPerChannel);
+	}
+
+
+	ClariusFramePool::Buffer::Buffer(Buffer&& other) noexcept
+		: m_state(std::move(other.m_state))
+		, m_data(other.m_data)
+		, m_key(other.m_key)
+	{
+		other.m_data = nullptr;
+	}
+
+
+	ClariusFramePool::Buffer& ClariusFramePool::Buffer::operator=(Buffer&& other) noexcept
+	{
+		if (this != &other)
+		{
+			release();
+			m_state = std::move(other.m_state);
+			m_data = other.m_data;
+			m_key = other.m_key;
+			other.m_data = nullptr;
+		}
+		return *this;
+	}
+
+
+	ClariusFramePool::Buffer::~Buffer() { release(); }
+
+
+	void ClariusFramePool::Buffer::release()
+	{
+		if (m_data && m_state)
+			m_state->recycle(m_key, m_data);
+		m_data = nullptr;
+		m_state.reset();
+	}
+
+
+	ClariusFramePool::ClariusFramePool(size_t maxIdlePerKey)
+		: m_state(std::make_shared<Buffer::State>(maxIdlePerKey))
+	{
+	}
+
+
+	ClariusFramePool::~ClariusFramePool() = default;
+
+
+	ClariusFramePool::Buffer ClariusFramePool::acquire(const Key& key)
+	{
+		Buffer buffer;
+		buffer.m_key = key;
+		{
+			std::lock_guard<std::mutex> lock(m_state->mutex);
+			auto& list = m_state->idle[key];
+			if (!list.empty())
+			{
+				buffer.m_data = list.back();
+				list.pop_back();
+				m_state->reuses++;
+			}
+			else if (list.capacity() < m_state->maxIdlePerKey)
+				list.reserve(m_state->maxIdlePerKey);
+		}
+		if (!buffer.m_data)
+			buffer.m_data = m_state->allocate(key);
+
+		m_state->outstanding++;
+		buffer.m_state = m_state;
+		return buffer;
+	}
+
+
+	ClariusFramePool::Buffer ClariusFramePool::acquireBytes(size_t size)
+	{
+		const size_t granularity = 64 * 1024;
+		Key key;
+		key.width = static_cast<int>((size + granularity - 1) / granularity * granularity);
+		key.height = 1;
+		key.channels = 1;
+		return acquire(key);
+	}
+
+
+	void ClariusFramePool::clear()
+	{
+		std::map<Key, std::vector<unsigned char*>> idle;
+		{
+			std::lock_guard<std::mutex> lock(m_state->mutex);
+			idle.swap(m_state->idle);
+		}
+		for (auto& entry : idle)
+			for (unsigned char* ptr : entry.second)
+				Buffer::State::free(ptr);
+	}
+
+
+	ClariusFramePool::Stats ClariusFramePool::stats() const
+	{
+		Stats s;
+		s.allocations = m_state->allocations;
+		s.reuses = m_state->reuses;
+		s.outstanding = m_state->outstanding;
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		for (const auto& entry : m_state->idle)
+			s.idle += entry.second.size();
+		return s;
+	}
+}
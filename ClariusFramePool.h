@@ -0,0 +1,132 @@
+/* Copyright (c) 2012-2019 ImFusion GmbH, Munich, Germany. All rights reserved. */
+#pragma once
+
+#include <ImFusion/Base/TypedImage.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace ImFusion
+{
+	/**	\brief	Recycling pool of aligned frame buffers for the Clarius ingest path
+	 *
+	 *	Buffers are keyed by their dimensions and element size. Images handed out by acquireImage() use pooled
+	 *	storage which is returned to the pool as soon as the image is destroyed, i.e. once the last SharedImage or
+	 *	ImageStreamData referencing it is gone. In steady state, no pixel memory is allocated on the SDK callback thread.
+	 *	The pool can safely be destroyed while buffers are still handed out.
+	 */
+	class ClariusFramePool
+	{
+	public:
+		/// Identifies buffers of identical layout
+		struct Key
+		{
+			int width = 0;
+			int height = 0;
+			int channels = 0;
+			int bytesPerChannel = 1;
+
+			size_t byteSize() const { return static_cast<size_t>(width) * height * channels * bytesPerChannel; }
+			bool operator<(const Key& other) const;
+			bool operator==(const Key& other) const;
+		};
+
+		/// Cumulative pool statistics
+		struct Stats
+		{
+			size_t allocations = 0;    ///< Number of buffers allocated from the heap
+			size_t reuses = 0;         ///< Number of requests served with a recycled buffer
+			size_t outstanding = 0;    ///< Number of buffers currently handed out
+			size_t idle = 0;           ///< Number of buffers currently kept in the pool
+		};
+
+		/// Move-only handle to a pooled buffer, which is returned to the pool on destruction
+		class Buffer
+		{
+		public:
+			Buffer() = default;
+			Buffer(Buffer&& other) noexcept;
+			Buffer& operator=(Buffer&& other) noexcept;
+			Buffer(const Buffer&) = delete;
+			Buffer& operator=(const Buffer&) = delete;
+			~Buffer();
+
+			unsigned char* data() const { return m_data; }
+			size_t size() const { return m_key.byteSize(); }
+			const Key& key() const { return m_key; }
+			explicit operator bool() const { return m_data != nullptr; }
+
+			/// Returns the buffer to the pool, the handle is empty afterwards
+			void release();
+
+		private:
+			friend class ClariusFramePool;
+			struct State;
+			std::shared_ptr<State> m_state;
+			unsigned char* m_data = nullptr;
+			Key m_key;
+		};
+
+		/// Constructor, at most maxIdlePerKey unused buffers are kept per key
+		explicit ClariusFramePool(size_t maxIdlePerKey = 8);
+
+		~ClariusFramePool();
+
+		/// Returns a buffer for the given key, recycling an idle one if possible
+		Buffer acquire(const Key& key);
+
+		/// Returns a byte buffer of at least the given size, sizes are rounded up to limit the number of distinct keys
+		Buffer acquireBytes(size_t size);
+
+		/// Returns an image of the given size whose pixel storage comes from the pool
+		template <typename T>
+		std::unique_ptr<TypedImage<T>> acquireImage(int width, int height, int channels);
+
+		/// Frees all idle buffers, handed out buffers are not affected
+		void clear();
+
+		Stats stats() const;
+
+		/// Alignment of all pooled buffers (page size)
+		static constexpr size_t alignment() { return 4096; }
+
+	private:
+		static PixelType pixelTypeOf(unsigned char*) { return PixelType::UByte; }
+		static PixelType pixelTypeOf(short*) { return PixelType::Short; }
+		static PixelType pixelTypeOf(unsigned short*) { return PixelType::UShort; }
+		static PixelType pixelTypeOf(float*) { return PixelType::Float; }
+
+		std::shared_ptr<Buffer::State> m_state;
+	};
+
+
+	/// TypedImage which keeps a pooled buffer alive and hands it back to the pool on destruction
+	template <typename T>
+	class ClariusPooledImage : public TypedImage<T>
+	{
+	public:
+		ClariusPooledImage(const ImageDescriptor& desc, ClariusFramePool::Buffer&& buffer)
+			: TypedImage<T>(desc, reinterpret_cast<T*>(buffer.data()), false)
+			, m_buffer(std::move(buffer))
+		{
+		}
+
+	private:
+		ClariusFramePool::Buffer m_buffer;
+	};
+
+
+	template <typename T>
+	std::unique_ptr<TypedImage<T>> ClariusFramePool::acquireImage(int width, int height, int channels)
+	{
+		Key key;
+		key.width = width;
+		key.height = height;
+		key.channels = channels;
+		key.bytesPerChannel = static_cast<int>(sizeof(T));
+		Buffer buffer = acquire(key);
+		ImageDescriptor desc(pixelTypeOf(static_cast<T*>(nullptr)), vec3i(width, height, 1), channels);
+		return std::make_unique<ClariusPooledImage<T>>(desc, std::move(buffer));
+	}
+}
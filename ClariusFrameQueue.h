@@ -0,0 +1,200 @@
+/* Copyright (c) 2012-2019 ImFusion GmbH, Munich, Germany. All rights reserved. */
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace ImFusion
+{
+	/// Behavior of a ClariusFrameQueue when a frame arrives while it is full
+	enum class ClariusDropPolicy
+	{
+		DropOldest = 0,    ///< The oldest queued frame is discarded
+		DropNewest = 1,    ///< The arriving frame is discarded
+		KeepLatest = 2,    ///< Only the most recent frame is kept, for lowest latency, the capacity is ignored
+		Block = 3          ///< The producer waits for free space up to a timeout, then the arriving frame is discarded
+	};
+
+
+	/// Statistics of a ClariusFrameQueue
+	struct ClariusFrameQueueStats
+	{
+		size_t capacity = 0;         ///< Maximum number of queued frames
+		size_t depth = 0;            ///< Number of currently queued frames
+		size_t highWater = 0;        ///< Maximum number of queued frames observed
+		size_t pushed = 0;           ///< Number of frames accepted
+		size_t popped = 0;           ///< Number of frames handed to the consumer
+		size_t droppedOldest = 0;    ///< Number of queued frames discarded by DropOldest
+		size_t droppedNewest = 0;    ///< Number of arriving frames discarded by DropNewest or a Block timeout
+		size_t superseded = 0;       ///< Number of queued frames replaced by a newer one with KeepLatest
+		size_t blocked = 0;          ///< Number of pushes that had to wait for free space with Block
+	};
+
+
+	/**	\brief	Bounded single-producer single-consumer queue of frames with a configurable drop policy
+	 *
+	 *	The queue owns its elements in a fixed ring of slots, so queuing does not allocate and discarded frames are
+	 *	released right away. When the queue is full, the drop policy decides which frame is lost, so that overload shows
+	 *	up as individual dropped frames instead of a flushed queue. The mutex only guards moving pointers in and out of
+	 *	the ring, except for the Block policy, where the producer waits on it for the consumer.
+	 */
+	template <typename T>
+	class ClariusFrameQueue
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		explicit ClariusFrameQueue(size_t capacity = 50, ClariusDropPolicy policy = ClariusDropPolicy::DropOldest)
+		{
+			configure(capacity, policy);
+		}
+
+		/// Changes capacity and policy, frames exceeding a reduced capacity are discarded starting with the oldest one
+		void configure(size_t capacity, ClariusDropPolicy policy, int maxBlockMs = 50)
+		{
+			std::vector<std::unique_ptr<T>> items;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				capacity = std::max<size_t>(capacity, 1);
+				while (m_count > capacity)
+				{
+					takeFront().reset();
+					m_stats.droppedOldest++;
+				}
+				while (m_count > 0)
+					items.push_back(takeFront());
+				m_slots.clear();
+				m_slots.resize(capacity);
+				m_head = 0;
+				for (auto& item : items)
+				{
+					m_slots[m_count].item = std::move(item);
+					m_slots[m_count++].enqueued = Clock::now();
+				}
+				m_policy = policy;
+				m_maxBlock = std::chrono::milliseconds(std::max(maxBlockMs, 0));
+				m_stats.capacity = capacity;
+			}
+			m_spaceAvailable.notify_all();
+		}
+
+		/// Queues a frame, returns false if it was discarded instead
+		bool push(std::unique_ptr<T> item)
+		{
+			std::unique_ptr<T> dropped;    // released outside of the lock
+			std::unique_lock<std::mutex> lock(m_mutex);
+			if (m_policy == ClariusDropPolicy::KeepLatest)
+			{
+				while (m_count > 0)
+				{
+					dropped = takeFront();
+					m_stats.superseded++;
+				}
+			}
+			else if (m_count == m_slots.size())
+			{
+				if (m_policy == ClariusDropPolicy::DropOldest)
+				{
+					dropped = takeFront();
+					m_stats.droppedOldest++;
+				}
+				else if (m_policy == ClariusDropPolicy::Block)
+				{
+					m_stats.blocked++;
+					m_spaceAvailable.wait_for(lock, m_maxBlock, [this] { return m_count < m_slots.size(); });
+				}
+
+				if (m_count == m_slots.size())
+				{
+					m_stats.droppedNewest++;
+					return false;
+				}
+			}
+
+			Slot& slot = m_slots[(m_head + m_count) % m_slots.size()];
+			slot.item = std::move(item);
+			slot.enqueued = Clock::now();
+			m_count++;
+			m_stats.pushed++;
+			m_stats.highWater = std::max(m_stats.highWater, m_count);
+			return true;
+		}
+
+		/// Removes the oldest frame, null if the queue is empty
+		/// If enqueued is given, it receives the time the frame was pushed.
+		std::unique_ptr<T> pop(Clock::time_point* enqueued = nullptr)
+		{
+			std::unique_ptr<T> item;
+			bool blocking;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_count == 0)
+					return nullptr;
+				if (enqueued)
+					*enqueued = m_slots[m_head].enqueued;
+				item = takeFront();
+				m_stats.popped++;
+				blocking = m_policy == ClariusDropPolicy::Block;
+			}
+			if (blocking)
+				m_spaceAvailable.notify_one();
+			return item;
+		}
+
+		bool empty() const
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_count == 0;
+		}
+
+		/// Discards all queued frames and releases a blocked producer
+		void clear()
+		{
+			std::vector<std::unique_ptr<T>> items;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				while (m_count > 0)
+					items.push_back(takeFront());
+			}
+			m_spaceAvailable.notify_all();
+		}
+
+		ClariusFrameQueueStats stats() const
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			ClariusFrameQueueStats s = m_stats;
+			s.depth = m_count;
+			return s;
+		}
+
+	private:
+		/// Moves the oldest frame out of the ring, the mutex must be held and the queue must not be empty
+		std::unique_ptr<T> takeFront()
+		{
+			std::unique_ptr<T> item = std::move(m_slots[m_head].item);
+			m_head = (m_head + 1) % m_slots.size();
+			m_count--;
+			return item;
+		}
+
+		struct Slot
+		{
+			std::unique_ptr<T> item;
+			Clock::time_point enqueued;
+		};
+
+		mutable std::mutex m_mutex;                  ///< Protects all members below
+		std::condition_variable m_spaceAvailable;    ///< Notifies a producer blocked by the Block policy
+		std::vector<Slot> m_slots;
+		size_t m_head = 0;
+		size_t m_count = 0;
+		ClariusDropPolicy m_policy = ClariusDropPolicy::DropOldest;
+		std::chrono::milliseconds m_maxBlock = std::chrono::milliseconds(50);
+		ClariusFrameQueueStats m_stats;
+	};
+}
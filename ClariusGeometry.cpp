@@ -0,0 +1,177 @@
+#include "ClariusGeometry.h"
+
+#include <ImFusion/US/FrameGeometryConvex.h>
+#include <ImFusion/US/FrameGeometryLinear.h>
+
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+namespace ImFusion
+{
+	namespace ClariusGeometry
+	{
+		namespace
+		{
+			const double pi = 3.14159265358979323846;
+		}
+
+
+		std::unique_ptr<US::FrameGeometry> fromProbe(const ClariusProbeInfo& probe, const ClariusImageInfo& image, vec2i size)
+		{
+			if (probe.elements <= 0 || probe.pitch <= 0 || image.micronsPerPixel <= 0.0 || size[0] <= 0 || size[1] <= 0)
+				return nullptr;
+
+			const double pixelSize = image.micronsPerPixel * 1.e-3;    // mm
+			const double aperture = probe.elements * probe.pitch * 1.e-3;
+			const vec2 extent(size[0] * pixelSize, size[1] * pixelSize);
+			// center of the probe face relative to the image center
+			const vec2 face = vec2(image.originX, image.originY) * 1.e-3 - 0.5 * extent;
+			const double depth = extent[1] - image.originY * 1.e-3;
+			if (depth <= 0.0)
+				return nullptr;
+
+			if (probe.radius > 0)
+			{
+				auto geometry = std::make_unique<US::FrameGeometryConvex>(US::FrameGeometry::CoordinateSystem::Image);
+				geometry->setShortRadius(probe.radius);
+				geometry->setLongRadius(probe.radius + depth);
+				geometry->setOpeningAngle(aperture / probe.radius * 180.0 / pi);
+				geometry->setOffset(face - vec2(0.0, probe.radius));    // apex
+				return geometry;
+			}
+
+			auto geometry = std::make_unique<US::FrameGeometryLinear>(US::FrameGeometry::CoordinateSystem::Image);
+			geometry->setWidth(aperture);
+			geometry->setDepth(depth);
+			geometry->setOffset(face);
+			return geometry;
+		}
+
+
+		bool agrees(const US::FrameGeometry& a, const US::FrameGeometry& b, double toleranceMm)
+		{
+			if ((a.offset() - b.offset()).norm() > toleranceMm)
+				return false;
+
+			auto convexA = dynamic_cast<const US::FrameGeometryConvex*>(&a);
+			auto convexB = dynamic_cast<const US::FrameGeometryConvex*>(&b);
+			if (convexA && convexB)
+			{
+				const double arc = std::abs(convexA->openingAngle() - convexB->openingAngle()) * pi / 180.0 * convexA->shortRadius();
+				return std::abs(convexA->shortRadius() - convexB->shortRadius()) <= toleranceMm &&
+					   std::abs(convexA->longRadius() - convexB->longRadius()) <= toleranceMm && arc <= toleranceMm;
+			}
+
+			auto linearA = dynamic_cast<const US::FrameGeometryLinear*>(&a);
+			auto linearB = dynamic_cast<const US::FrameGeometryLinear*>(&b);
+			if (linearA && linearB)
+				return std::abs(linearA->width() - linearB->width()) <= toleranceMm && std::abs(linearA->depth() - linearB->depth()) <= toleranceMm;
+
+			return false;
+		}
+
+
+		PixelRect boundingBox(const US::FrameGeometry& geometry, vec2i size, double pixelSize)
+		{
+			if (geometry.coordinateSystem() != US::FrameGeometry::CoordinateSystem::Image || pixelSize <= 0.0)
+				return {};
+
+			// extent in millimeters relative to the image center, y pointing down
+			vec2 lower, upper;
+			if (auto convex = dynamic_cast<const US::FrameGeometryConvex*>(&geometry))
+			{
+				// extremes of the annular sector lie on its corners or where it crosses the axes
+				const double halfAngle = 0.5 * convex->openingAngle() * pi / 180.0;
+				std::vector<double> angles = {-halfAngle, halfAngle, 0.0};
+				if (halfAngle > 0.5 * pi)
+				{
+					angles.push_back(-0.5 * pi);
+					angles.push_back(0.5 * pi);
+				}
+				lower = vec2::Constant(std::numeric_limits<double>::max());
+				upper = vec2::Constant(std::numeric_limits<double>::lowest());
+				for (double radius : {convex->shortRadius(), convex->longRadius()})
+					for (double angle : angles)
+					{
+						const vec2 p = geometry.offset() + radius * vec2(std::sin(angle), std::cos(angle));
+						lower = lower.cwiseMin(p);
+						upper = upper.cwiseMax(p);
+					}
+			}
+			else if (auto linear = dynamic_cast<const US::FrameGeometryLinear*>(&geometry))
+			{
+				lower = geometry.offset() - vec2(0.5 * linear->width(), 0.0);
+				upper = geometry.offset() + vec2(0.5 * linear->width(), linear->depth());
+			}
+			else
+				return {};
+
+			const vec2 center = 0.5 * size.cast<double>();
+			const vec2i first = (lower / pixelSize + center).array().floor().cast<int>().max(0).min(size.array());
+			const vec2i last = (upper / pixelSize + center).array().ceil().cast<int>().max(0).min(size.array());
+			PixelRect rect;
+			if ((last.array() > first.array()).all())
+			{
+				rect.origin = first;
+				rect.size = last - first;
+			}
+			return rect;
+		}
+
+
+		std::string toString(const US::FrameGeometry& geometry)
+		{
+			std::ostringstream ss;
+			ss << std::setprecision(std::numeric_limits<double>::max_digits10);
+			ss << (geometry.coordinateSystem() == US::FrameGeometry::CoordinateSystem::Pixels ? "pixels " : "image ");
+			if (auto convex = dynamic_cast<const US::FrameGeometryConvex*>(&geometry))
+				ss << "convex " << convex->shortRadius() << " " << convex->longRadius() << " " << convex->openingAngle();
+			else if (auto linear = dynamic_cast<const US::FrameGeometryLinear*>(&geometry))
+				ss << "linear " << linear->width() << " " << linear->depth();
+			else
+				return "";
+			ss << " " << geometry.offset().x() << " " << geometry.offset().y();
+			return ss.str();
+		}
+
+
+		std::unique_ptr<US::FrameGeometry> fromString(const std::string& text)
+		{
+			std::istringstream ss(text);
+			std::string system, type;
+			ss >> system >> type;
+			if (system != "image" && system != "pixels")
+				return nullptr;
+			const auto cs = system == "pixels" ? US::FrameGeometry::CoordinateSystem::Pixels : US::FrameGeometry::CoordinateSystem::Image;
+			if (type == "convex")
+			{
+				double shortRadius, longRadius, openingAngle;
+				vec2 offset;
+				if (!(ss >> shortRadius >> longRadius >> openingAngle >> offset.x() >> offset.y()))
+					return nullptr;
+				auto geometry = std::make_unique<US::FrameGeometryConvex>(cs);
+				geometry->setShortRadius(shortRadius);
+				geometry->setLongRadius(longRadius);
+				geometry->setOpeningAngle(openingAngle);
+				geometry->setOffset(offset);
+				return geometry;
+			}
+			if (type == "linear")
+			{
+				double width, depth;
+				vec2 offset;
+				if (!(ss >> width >> depth >> offset.x() >> offset.y()))
+					return nullptr;
+				auto geometry = std::make_unique<US::FrameGeometryLinear>(cs);
+				geometry->setWidth(width);
+				geometry->setDepth(depth);
+				geometry->setOffset(offset);
+				return geometry;
+			}
+			return nullptr;
+		}
+	}
+}
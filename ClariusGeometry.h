@@ -0,0 +1,48 @@
+/* Copyright (c) 2012-2019 ImFusion GmbH, Munich, Germany. All rights reserved. */
+#pragma once
+
+#include "ClariusApi.h"
+
+#include <memory>
+#include <string>
+
+namespace ImFusion
+{
+	namespace US
+	{
+		class FrameGeometry;
+	}
+
+	/// Frame geometry of Clarius images derived from the probe description
+	namespace ClariusGeometry
+	{
+		/// Creates the geometry of a processed frame of the given size in pixels from the probe and imaging information
+		/// The geometry uses image coordinates in millimeters. A convex sector is created if the probe reports a radius
+		/// and a linear field of view otherwise. The field of view spans elements x pitch (in microns) along the probe
+		/// face, whose center is at the image origin reported with the frame, and reaches to the bottom of the image.
+		/// Returns null if the information is incomplete.
+		std::unique_ptr<US::FrameGeometry> fromProbe(const ClariusProbeInfo& probe, const ClariusImageInfo& image, vec2i size);
+
+		/// Returns true if both geometries are of the same type and their dimensions differ by at most toleranceMm
+		/// Opening angles are compared by the arc length they span at the short radius.
+		bool agrees(const US::FrameGeometry& a, const US::FrameGeometry& b, double toleranceMm);
+
+		/// Rectangle of pixels
+		struct PixelRect
+		{
+			vec2i origin = vec2i::Zero();    ///< Top left pixel
+			vec2i size = vec2i::Zero();      ///< Width and height in pixels, zero if empty
+		};
+
+		/// Tight bounding box of the field of view of a convex or linear geometry in an image of the given size
+		/// The geometry must use image coordinates, pixelSize is the spacing of the image in millimeters. The box is
+		/// rounded outwards to whole pixels and clamped to the image. Returns an empty rectangle for other geometries.
+		PixelRect boundingBox(const US::FrameGeometry& geometry, vec2i size, double pixelSize);
+
+		/// Single line text representation of a convex or linear geometry, empty for other types
+		std::string toString(const US::FrameGeometry& geometry);
+
+		/// Parses the representation written by toString(), returns null if it is invalid
+		std::unique_ptr<US::FrameGeometry> fromString(const std::string& text);
+	}
+}
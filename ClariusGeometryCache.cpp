@@ -0,0 +1,155 @@
+#include "ClariusGeometryCache.h"
+
+#include "ClariusGeometry.h"
+
+#include <ImFusion/Core/Log.h>
+#include <ImFusion/US/FrameGeometry.h>
+
+#include <QDir>
+#include <QStandardPaths>
+
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+#undef IMFUSION_LOG_DEFAULT_CATEGORY
+#define IMFUSION_LOG_DEFAULT_CATEGORY "ClariusGeometryCache"
+
+
+namespace ImFusion
+{
+	std::string ClariusGeometryCache::defaultPath()
+	{
+		return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation).toStdString() + "/ClariusGeometryCache.txt";
+	}
+
+
+	std::string ClariusGeometryCache::probeIdentity(int version, int elements, int pitch, int radius, const std::string& firmware)
+	{
+		std::ostringstream ss;
+		ss << "v" << version << "-e" << elements << "-p" << pitch << "-r" << radius << "-fw";
+		// the identity is stored as a single token
+		for (char c : firmware)
+			ss << (std::isspace(static_cast<unsigned char>(c)) ? '_' : c);
+		return ss.str();
+	}
+
+
+	bool ClariusGeometryCache::load(const std::string& path)
+	{
+		std::ifstream file(path);
+		if (!file)
+			return false;
+
+		std::unordered_map<Key, std::shared_ptr<const US::FrameGeometry>, KeyHash> entries;
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream ss(line);
+			Key key;
+			std::string geometryText;
+			if (!(ss >> key.probe >> key.size[0] >> key.size[1] >> key.micronsPerPixel >> key.signature) || !std::getline(ss, geometryText))
+				continue;
+			if (auto geometry = ClariusGeometry::fromString(geometryText))
+				entries[key] = std::move(geometry);
+			else
+				LOG_WARN("Skipping invalid entry in " << path);
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_entries = std::move(entries);
+		m_modified = false;
+		return true;
+	}
+
+
+	bool ClariusGeometryCache::save(const std::string& path)
+	{
+		std::ostringstream ss;
+		ss << std::setprecision(std::numeric_limits<double>::max_digits10);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_modified)
+				return true;
+			for (const auto& entry : m_entries)
+			{
+				const std::string geometryText = ClariusGeometry::toString(*entry.second);
+				if (geometryText.empty())
+					continue;
+				const Key& key = entry.first;
+				ss << key.probe << " " << key.size[0] << " " << key.size[1] << " " << key.micronsPerPixel << " " << key.signature << " "
+				   << geometryText << "\n";
+			}
+			m_modified = false;
+		}
+
+		// write to a temporary file first, so that an interrupted save does not destroy the cache
+		const std::string tmpPath = path + ".tmp";
+		QDir().mkpath(QString::fromStdString(path.substr(0, path.find_last_of("/\\") + 1)));
+		{
+			std::ofstream file(tmpPath, std::ios::trunc);
+			file << ss.str();
+			if (!file)
+			{
+				LOG_WARN("Could not write " << tmpPath);
+				return false;
+			}
+		}
+		std::remove(path.c_str());
+		if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+		{
+			LOG_WARN("Could not write " << path);
+			return false;
+		}
+		return true;
+	}
+
+
+	std::shared_ptr<const US::FrameGeometry> ClariusGeometryCache::find(const Key& key)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_entries.find(key);
+		if (it == m_entries.end())
+		{
+			m_misses++;
+			return nullptr;
+		}
+		m_hits++;
+		return it->second;
+	}
+
+
+	void ClariusGeometryCache::insert(const Key& key, std::shared_ptr<const US::FrameGeometry> geometry)
+	{
+		if (!geometry)
+			return;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_entries[key] = std::move(geometry);
+		m_modified = true;
+	}
+
+
+	ClariusGeometryCache::Stats ClariusGeometryCache::stats() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Stats s;
+		s.entries = m_entries.size();
+		s.hits = m_hits;
+		s.misses = m_misses;
+		return s;
+	}
+
+
+	size_t ClariusGeometryCache::KeyHash::operator()(const Key& key) const
+	{
+		size_t h = std::hash<std::string>()(key.probe);
+		h = h * 33 + std::hash<int>()(key.size[0]);
+		h = h * 33 + std::hash<int>()(key.size[1]);
+		h = h * 33 + std::hash<double>()(key.micronsPerPixel);
+		h = h * 33 + key.signature;
+		return h;
+	}
+}
@@ -0,0 +1,80 @@
+/* Copyright (c) 2012-2019 ImFusion GmbH, Munich, Germany. All rights reserved. */
+#pragma once
+
+#include <ImFusion/Core/Mat.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace ImFusion
+{
+	namespace US
+	{
+		class FrameGeometry;
+	}
+
+	/**	\brief	Detected frame geometries of previously seen imaging configurations, persisted across sessions
+	 *
+	 *	Entries are keyed by probe identity, output size, pixel size (and hence depth) and mask signature, so that a
+	 *	configuration seen before gets its geometry without running the detection. Lookups are a hash map access under a
+	 *	mutex and are only needed when the mask signature changes. The file is a plain text file with one entry per
+	 *	line, read by load() and written by save().
+	 */
+	class ClariusGeometryCache
+	{
+	public:
+		struct Key
+		{
+			std::string probe;                 ///< Identity of the probe, see ClariusGeometryCache::probeIdentity()
+			vec2i size = vec2i::Zero();        ///< Image size in pixels
+			double micronsPerPixel = 0.0;      ///< Pixel size, determines the depth together with the image height
+			unsigned int signature = 0;        ///< Signature of the mask or the imaging parameters
+
+			bool operator==(const Key& other) const
+			{
+				return probe == other.probe && size == other.size && micronsPerPixel == other.micronsPerPixel && signature == other.signature;
+			}
+		};
+
+		struct Stats
+		{
+			size_t entries = 0;    ///< Number of cached geometries
+			size_t hits = 0;       ///< Number of lookups that found a geometry
+			size_t misses = 0;     ///< Number of lookups that did not find a geometry
+		};
+
+		/// Default location of the cache file in the application data directory
+		static std::string defaultPath();
+
+		/// Identity string of a probe from its reported properties and firmware version
+		static std::string probeIdentity(int version, int elements, int pitch, int radius, const std::string& firmware);
+
+		/// Replaces the cached entries by the ones stored in the file, returns false if it could not be read
+		bool load(const std::string& path);
+
+		/// Writes all entries to the file if any were added since the last load() or save(), returns false on failure
+		bool save(const std::string& path);
+
+		/// Cached geometry for the given configuration, null if there is none
+		std::shared_ptr<const US::FrameGeometry> find(const Key& key);
+
+		/// Adds or replaces the geometry of the given configuration
+		void insert(const Key& key, std::shared_ptr<const US::FrameGeometry> geometry);
+
+		Stats stats() const;
+
+	private:
+		struct KeyHash
+		{
+			size_t operator()(const Key& key) const;
+		};
+
+		mutable std::mutex m_mutex;    ///< Protects all members below
+		std::unordered_map<Key, std::shared_ptr<const US::FrameGeometry>, KeyHash> m_entries;
+		bool m_modified = false;       ///< True if entries were added since the last load() or save()
+		size_t m_hits = 0;
+		size_t m_misses = 0;
+	};
+}
@@ -0,0 +1,118 @@
+#include "ClariusGeometryDetector.h"
+
+#include <ImFusion/Core/Log.h>
+#include <ImFusion/US/FrameGeometry.h>
+#include <ImFusion/US/GeometryDetection.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+
+#undef IMFUSION_LOG_DEFAULT_CATEGORY
+#define IMFUSION_LOG_DEFAULT_CATEGORY "ClariusGeometryDetector"
+
+
+namespace ImFusion
+{
+	struct ClariusGeometryDetector::Impl
+	{
+		std::future<void> detectionThread;            ///< Future wrapping the detection thread
+		std::condition_variable conditionVariable;    ///< Notifies the detection thread about new requests
+		std::mutex mutex;                             ///< Protects the pending request and the statistics
+		std::atomic<bool> stopExecution = {false};    ///< Flag whether to stop the execution of the detection thread
+
+		std::unique_ptr<TypedImage<unsigned char>> pendingMask;    ///< Latest request not started yet
+		unsigned int pendingSignature = 0;
+		std::shared_ptr<const Result> result;                      ///< Only accessed through std::atomic_load/atomic_store
+		Stats stats;
+	};
+
+
+	ClariusGeometryDetector::ClariusGeometryDetector()
+		: m_pimpl(new Impl())
+	{
+		m_pimpl->detectionThread = std::async(std::launch::async, [this]() {
+			try
+			{
+				std::unique_lock<std::mutex> lock(m_pimpl->mutex);
+				while (!m_pimpl->stopExecution)
+				{
+					if (!m_pimpl->pendingMask)
+					{
+						m_busy = false;
+						m_pimpl->conditionVariable.wait_for(lock, std::chrono::milliseconds(100));    // go hibernate
+						continue;
+					}
+
+					std::unique_ptr<TypedImage<unsigned char>> mask = std::move(m_pimpl->pendingMask);
+					auto result = std::make_shared<Result>();
+					result->signature = m_pimpl->pendingSignature;
+					lock.unlock();
+
+					const auto start = std::chrono::steady_clock::now();
+					US::GeometryDetection det;
+					result->geometry = det.compute(mask.get());
+					const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+					const bool found = result->geometry != nullptr;
+					std::atomic_store(&m_pimpl->result, std::shared_ptr<const Result>(std::move(result)));
+
+					lock.lock();
+					Stats& s = m_pimpl->stats;
+					s.detections++;
+					if (!found)
+						s.failed++;
+					s.lastMs = ms;
+					s.meanMs += (ms - s.meanMs) / s.detections;
+					s.maxMs = std::max(s.maxMs, ms);
+				}
+			}
+			catch (std::exception& e)
+			{
+				LOG_ERROR("An unexpected exception occurred while running the detection thread. " << e.what());
+			}
+			m_busy = false;
+		});
+	}
+
+
+	ClariusGeometryDetector::~ClariusGeometryDetector()
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_pimpl->mutex);
+			m_pimpl->stopExecution = true;
+		}
+		while (m_pimpl->detectionThread.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready)
+			m_pimpl->conditionVariable.notify_one();
+	}
+
+
+	void ClariusGeometryDetector::detect(std::unique_ptr<TypedImage<unsigned char>> mask, unsigned int signature)
+	{
+		if (!mask)
+			return;
+		{
+			std::lock_guard<std::mutex> lock(m_pimpl->mutex);
+			if (m_pimpl->pendingMask)
+				m_pimpl->stats.superseded++;
+			m_pimpl->pendingMask = std::move(mask);
+			m_pimpl->pendingSignature = signature;
+			m_busy = true;
+		}
+		m_pimpl->conditionVariable.notify_one();
+	}
+
+
+	std::shared_ptr<const ClariusGeometryDetector::Result> ClariusGeometryDetector::result() const
+	{
+		return std::atomic_load(&m_pimpl->result);
+	}
+
+
+	ClariusGeometryDetector::Stats ClariusGeometryDetector::stats() const
+	{
+		std::lock_guard<std::mutex> lock(m_pimpl->mutex);
+		return m_pimpl->stats;
+	}
+}
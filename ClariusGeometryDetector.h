@@ -0,0 +1,67 @@
+/* Copyright (c) 2012-2019 ImFusion GmbH, Munich, Germany. All rights reserved. */
+#pragma once
+
+#include <ImFusion/Base/TypedImage.h>
+
+#include <atomic>
+#include <memory>
+
+namespace ImFusion
+{
+	namespace US
+	{
+		class FrameGeometry;
+	}
+
+	/**	\brief	Runs the image-based frame geometry detection on a background thread
+	 *
+	 *	Detection takes several frame intervals on large images, so it must not run in the image callback. detect()
+	 *	only hands over the mask and returns immediately. A request that has not been started yet is replaced by a
+	 *	newer one, so after a series of depth or zoom changes only the latest mask is processed. Finished results are
+	 *	published atomically and can be polled from any thread without blocking.
+	 */
+	class ClariusGeometryDetector
+	{
+	public:
+		/// Outcome of a detection
+		struct Result
+		{
+			std::shared_ptr<const US::FrameGeometry> geometry;    ///< Detected geometry, null if the detection failed
+			unsigned int signature = 0;                           ///< Signature of the mask the geometry was detected on
+		};
+
+		/// Timings of the finished detections
+		struct Stats
+		{
+			size_t detections = 0;    ///< Number of finished detections
+			size_t failed = 0;        ///< Number of detections that did not find a geometry
+			size_t superseded = 0;    ///< Number of requests replaced by a newer one before they were started
+			double lastMs = 0.0;      ///< Duration of the most recent detection
+			double meanMs = 0.0;      ///< Average duration of a detection
+			double maxMs = 0.0;       ///< Maximum duration of a detection
+		};
+
+		/// Starts the detection thread
+		ClariusGeometryDetector();
+
+		/// Stops the detection thread, waits for a running detection to finish
+		~ClariusGeometryDetector();
+
+		/// Requests the detection of the geometry in the given mask, returns immediately
+		void detect(std::unique_ptr<TypedImage<unsigned char>> mask, unsigned int signature);
+
+		/// Most recent result, null if no detection has finished yet
+		std::shared_ptr<const Result> result() const;
+
+		/// True if a requested detection has not finished yet
+		bool busy() const { return m_busy; }
+
+		Stats stats() const;
+
+	private:
+		struct Impl;
+		std::unique_ptr<Impl> m_pimpl;
+
+		std::atomic<bool> m_busy = {false};
+	};
+}
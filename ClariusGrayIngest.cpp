@@ -0,0 +1,41 @@
+#include "ClariusGrayIngest.h"
+
+#include "ClariusApi.h"
+#include "ClariusKernels.h"
+
+#include <ImFusion/Base/TypedImage.h>
+
+namespace ImFusion
+{
+	std::unique_ptr<TypedImage<unsigned char>> ClariusGrayIngest::convert(ClariusFramePool& pool, const uint8_t* argb, int width, int height, ClariusImageInfo& info)
+	{
+		const size_t numPixels = static_cast<size_t>(width) * height;
+		const double pixelSize = info.micronsPerPixel * 1.e-3;
+		auto gray = pool.acquireImage<unsigned char>(width, height, 1);
+		gray->setSpacing(pixelSize, pixelSize, 1., true);
+
+		// without a mask of matching size the alpha channel is extracted in the same pass
+		std::unique_ptr<TypedImage<unsigned char>> mask;
+		if (!m_mask || m_mask->width() != width || m_mask->height() != height || m_micronsPerPixel != info.micronsPerPixel)
+			mask = TypedImage<unsigned char>::create(vec3i(width, height, 1), 1);
+		const unsigned int signature = ClariusKernels::argbToGray(argb, numPixels, gray->pointer(), mask ? mask->pointer() : nullptr);
+		if (!mask && signature != m_signature)
+		{
+			// the valid region changed, which only happens with the imaging parameters
+			mask = TypedImage<unsigned char>::create(vec3i(width, height, 1), 1);
+			ClariusKernels::extractAlpha(argb, numPixels, mask->pointer());
+		}
+		if (mask)
+		{
+			mask->setSpacing(pixelSize, pixelSize, 1., true);
+			m_mask = std::move(mask);
+			m_signature = signature;
+			m_micronsPerPixel = info.micronsPerPixel;
+		}
+
+		info.mask = m_mask;
+		info.maskSignature = m_signature;
+		return gray;
+	}
+
+}
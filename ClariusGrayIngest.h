@@ -0,0 +1,32 @@
+/* Copyright (c) 2012-2019 ImFusion GmbH, Munich, Germany. All rights reserved. */
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+namespace ImFusion
+{
+	template <typename T>
+	class TypedImage;
+	class ClariusFramePool;
+	struct ClariusImageInfo;
+
+	/**	\brief	Converts uncompressed ARGB frames to grayscale while copying them out of the SDK buffer
+	 *
+	 *	Gray values and the signature of the alpha channel are computed in a single pass by ClariusKernels::argbToGray(),
+	 *	so the frame is read once and only a quarter of its size is written, instead of copying the full ARGB frame and
+	 *	converting it in a second pass. The alpha channel, which marks the valid image region, is only extracted when
+	 *	its signature changes and is then shared by all following frames through ClariusImageInfo::mask.
+	 */
+	class ClariusGrayIngest
+	{
+	public:
+		/// Converts the frame into a pooled grayscale image and sets the mask of info, calls must be serialized
+		std::unique_ptr<TypedImage<unsigned char>> convert(ClariusFramePool& pool, const uint8_t* argb, int width, int height, ClariusImageInfo& info);
+
+	private:
+		std::shared_ptr<const TypedImage<unsigned char>> m_mask;    ///< Alpha channel of the frames with m_signature
+		unsigned int m_signature = 0;
+		double m_micronsPerPixel = 0.0;
+	};
+}
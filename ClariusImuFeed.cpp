@@ -0,0 +1,103 @@
+#include "ClariusImuFeed.h"
+
+#include <ImFusion/Core/Log.h>
+
+#include <boost/lockfree/spsc_queue.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+
+#undef IMFUSION_LOG_DEFAULT_CATEGORY
+#define IMFUSION_LOG_DEFAULT_CATEGORY "ClariusImuFeed"
+
+
+namespace ImFusion
+{
+	struct ClariusImuFeed::Impl
+	{
+		explicit Impl(size_t capacity)
+			: samples(capacity)
+			, capacity(capacity)
+		{
+		}
+
+		boost::lockfree::spsc_queue<ClariusImuSample> samples;    ///< Samples from the SDK thread
+		const size_t capacity;
+		std::function<void(std::shared_ptr<const Batch>)> sink;
+		std::future<void> deliveryThread;             ///< Future wrapping the delivery thread
+		std::condition_variable conditionVariable;    ///< Condition variable for notification of the delivery thread
+		std::mutex mutex;                             ///< Mutex protecting access to conditionVariable
+		std::atomic<bool> stopExecution = {false};    ///< Flag whether to stop the execution of the delivery thread
+	};
+
+
+	ClariusImuFeed::ClariusImuFeed(std::function<void(std::shared_ptr<const Batch>)> sink, size_t capacity)
+		: m_pimpl(new Impl(std::max<size_t>(capacity, 2)))
+	{
+		m_pimpl->sink = std::move(sink);
+		m_pimpl->deliveryThread = std::async(std::launch::async, [this]() {
+			try
+			{
+				std::unique_lock<std::mutex> lock(m_pimpl->mutex);
+				while (!m_pimpl->stopExecution)
+				{
+					const size_t batchSize = static_cast<size_t>(std::max(m_batchSize.load(), 1));
+					m_pimpl->conditionVariable.wait_for(lock, std::chrono::milliseconds(std::max(m_maxLatencyMs.load(), 1)), [this, batchSize] {
+						return m_pimpl->stopExecution || m_pimpl->samples.read_available() >= batchSize;
+					});
+					if (m_pimpl->stopExecution)
+						break;
+
+					// deliver everything available, in batches of at most batchSize samples
+					while (m_pimpl->samples.read_available() > 0)
+					{
+						auto batch = std::make_shared<Batch>(std::min(m_pimpl->samples.read_available(), batchSize));
+						batch->resize(m_pimpl->samples.pop(batch->data(), batch->size()));
+						m_numDelivered += batch->size();
+						if (m_pimpl->sink)
+							m_pimpl->sink(std::move(batch));
+					}
+				}
+			}
+			catch (std::exception& e)
+			{
+				LOG_ERROR("An unexpected exception occurred while running the background thread. " << e.what());
+			}
+		});
+	}
+
+
+	ClariusImuFeed::~ClariusImuFeed()
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_pimpl->mutex);
+			m_pimpl->stopExecution = true;
+		}
+		while (m_pimpl->deliveryThread.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready)
+			m_pimpl->conditionVariable.notify_one();
+	}
+
+
+	bool ClariusImuFeed::push(const ClariusImuSample& sample)
+	{
+		if (!m_pimpl->samples.push(sample))
+		{
+			m_numDropped++;
+			return false;
+		}
+		// only wake up the delivery thread once a batch is complete, smaller batches are picked up after maxLatencyMs
+		const size_t queued = m_pimpl->capacity - m_pimpl->samples.write_available();
+		if (queued >= static_cast<size_t>(m_batchSize.load()))
+			m_pimpl->conditionVariable.notify_one();
+		return true;
+	}
+
+
+	void ClariusImuFeed::setBatching(int batchSize, int maxLatencyMs)
+	{
+		m_batchSize = std::max(batchSize, 1);
+		m_maxLatencyMs = std::max(maxLatencyMs, 1);
+	}
+}
@@ -0,0 +1,53 @@
+/* Copyright (c) 2012-2019 ImFusion GmbH, Munich, Germany. All rights reserved. */
+#pragma once
+
+#include "ClariusApi.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace ImFusion
+{
+	/**	\brief	Low-latency delivery of standalone IMU samples
+	 *
+	 *	The SDK thread pushes samples into a lock-free single-producer ring, so that push() never blocks or allocates.
+	 *	A delivery thread collects them into batches and hands every batch to the sink. A batch is delivered as soon as
+	 *	it holds batchSize samples, or after maxLatencyMs if fewer samples arrived, so a batch size of 1 delivers every
+	 *	sample individually with minimal latency. If the consumer cannot keep up, the newest samples are dropped.
+	 */
+	class ClariusImuFeed
+	{
+	public:
+		using Batch = std::vector<ClariusImuSample>;
+
+		/// Creates the feed and starts the delivery thread, the sink is called on this thread
+		explicit ClariusImuFeed(std::function<void(std::shared_ptr<const Batch>)> sink, size_t capacity = 4096);
+
+		/// Stops the delivery thread, samples not yet delivered are discarded
+		~ClariusImuFeed();
+
+		/// Adds a sample, must only be called from a single producer thread
+		/// Returns false if the ring is full and the sample was dropped.
+		bool push(const ClariusImuSample& sample);
+
+		/// Configures the batching, takes effect with the next batch
+		void setBatching(int batchSize, int maxLatencyMs);
+
+		/// Number of samples dropped because the ring was full
+		size_t numDropped() const { return m_numDropped; }
+
+		/// Number of samples delivered to the sink
+		size_t numDelivered() const { return m_numDelivered; }
+
+	private:
+		struct Impl;
+		std::unique_ptr<Impl> m_pimpl;
+
+		std::atomic<int> m_batchSize = {1};
+		std::atomic<int> m_maxLatencyMs = {5};
+		std::atomic<size_t> m_numDropped = {0};
+		std::atomic<size_t> m_numDelivered = {0};
+	};
+}
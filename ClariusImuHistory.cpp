@@ -0,0 +1,78 @@
+#include "ClariusImuHistory.h"
+
+#include <algorithm>
+
+namespace ImFusion
+{
+	ClariusImuHistory::ClariusImuHistory(size_t capacity)
+		: m_entries(std::max<size_t>(capacity, 2))
+	{
+	}
+
+
+	void ClariusImuHistory::add(const ClariusImuSample* samples, size_t count)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (size_t i = 0; i < count; i++)
+		{
+			if (m_size > 0 && samples[i].timestamp <= at(m_size - 1).timestamp)
+				continue;
+
+			Entry& entry = m_entries[(m_first + m_size) % m_entries.size()];
+			entry.timestamp = samples[i].timestamp;
+			entry.orientation = samples[i].orientation.normalized();
+			if (m_size < m_entries.size())
+				m_size++;
+			else
+				m_first = (m_first + 1) % m_entries.size();    // overwrote the oldest sample
+		}
+	}
+
+
+	bool ClariusImuHistory::orientationAt(unsigned long long timestamp, quat& orientation, unsigned long long maxExtrapolation) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_size == 0 || timestamp < at(0).timestamp)
+			return false;
+
+		const Entry& newest = at(m_size - 1);
+		if (timestamp >= newest.timestamp)
+		{
+			if (timestamp - newest.timestamp > maxExtrapolation)
+				return false;
+			orientation = newest.orientation;
+			return true;
+		}
+
+		// first sample newer than timestamp, exists since timestamp < newest.timestamp
+		size_t low = 0, high = m_size - 1;
+		while (low < high)
+		{
+			const size_t mid = low + (high - low) / 2;
+			if (at(mid).timestamp <= timestamp)
+				low = mid + 1;
+			else
+				high = mid;
+		}
+		const Entry& after = at(low);
+		const Entry& before = at(low - 1);    // low > 0 since at(0).timestamp <= timestamp
+		const double t = static_cast<double>(timestamp - before.timestamp) / static_cast<double>(after.timestamp - before.timestamp);
+		orientation = before.orientation.slerp(t, after.orientation);
+		return true;
+	}
+
+
+	size_t ClariusImuHistory::size() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_size;
+	}
+
+
+	void ClariusImuHistory::clear()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_first = 0;
+		m_size = 0;
+	}
+}
@@ -0,0 +1,54 @@
+/* Copyright (c) 2012-2019 ImFusion GmbH, Munich, Germany. All rights reserved. */
+#pragma once
+
+#include "ClariusApi.h"
+
+#include <mutex>
+#include <vector>
+
+namespace ImFusion
+{
+	/**	\brief	Short time-indexed history of IMU orientations
+	 *
+	 *	Samples are kept in a preallocated ring sorted by device timestamp, so adding samples and looking up the
+	 *	orientation at an arbitrary timestamp never allocate. Lookups use a binary search over the ring and
+	 *	spherically interpolate between the two neighbouring samples. Samples that are not newer than the latest
+	 *	sample in the history are ignored, which also removes duplicates if the same samples arrive through several
+	 *	callbacks.
+	 */
+	class ClariusImuHistory
+	{
+	public:
+		/// Constructor, the history keeps the most recent capacity samples
+		explicit ClariusImuHistory(size_t capacity = 1024);
+
+		/// Adds samples sorted by timestamp
+		void add(const ClariusImuSample* samples, size_t count);
+
+		/// Computes the orientation at the given device timestamp in nanoseconds
+		/// Timestamps up to maxExtrapolation nanoseconds after the newest sample use the newest orientation, since
+		/// frames may arrive before the IMU samples covering them. Returns false if the timestamp is not covered.
+		bool orientationAt(unsigned long long timestamp, quat& orientation, unsigned long long maxExtrapolation = 0) const;
+
+		/// Number of samples in the history
+		size_t size() const;
+
+		/// Removes all samples
+		void clear();
+
+	private:
+		struct Entry
+		{
+			unsigned long long timestamp = 0;
+			quat orientation = quat::Identity();
+		};
+
+		/// Entry with the given index, 0 being the oldest sample, m_mutex must be locked
+		const Entry& at(size_t index) const { return m_entries[(m_first + index) % m_entries.size()]; }
+
+		std::vector<Entry> m_entries;    ///< Ring of samples, allocated once
+		size_t m_first = 0;              ///< Ring index of the oldest sample
+		size_t m_size = 0;               ///< Number of valid samples
+		mutable std::mutex m_mutex;
+	};
+}
@@ -0,0 +1,189 @@
+// Microbenchmark of the per-frame kernels of the Clarius image callback
+//
+// Measures every full-image pass in isolation across image sizes and reports its throughput in bytes per cycle and
+// GB/s, relative to the memory bandwidth measured by a large memcpy. Bytes count everything read plus written.
+// Cycles are TSC ticks, i.e. at the nominal clock rate, and are not reported on platforms without a TSC.
+// Results are written as JSON, to stdout or to the file given with --output.
+//
+// Usage: ClariusKernelBenchmark [--output <file>]
+
+#include "ClariusKernels.h"
+
+#include <ImFusion/Base/ImageProcessing.h>
+#include <ImFusion/Base/TypedImage.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#	include <intrin.h>
+#	define CLARIUS_HAS_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#	include <x86intrin.h>
+#	define CLARIUS_HAS_TSC
+#endif
+
+using namespace ImFusion;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	/// Result of a single kernel at a single image size
+	struct Measurement
+	{
+		double ns = 0.0;        ///< Median time per call
+		double cycles = 0.0;    ///< Median TSC ticks per call, 0 without TSC
+	};
+
+	uint64_t ticks()
+	{
+#ifdef CLARIUS_HAS_TSC
+		return __rdtsc();
+#else
+		return 0;
+#endif
+	}
+
+	/// Runs the kernel repeatedly for at least minSeconds and returns the median duration of a call
+	Measurement measure(const std::function<void()>& kernel, double minSeconds = 0.2)
+	{
+		kernel();    // warm up caches and page in buffers
+		std::vector<double> ns, cycles;
+		const auto end = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(minSeconds));
+		while (Clock::now() < end || ns.size() < 5)
+		{
+			const uint64_t t0 = ticks();
+			const auto start = Clock::now();
+			kernel();
+			ns.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count());
+			cycles.push_back(static_cast<double>(ticks() - t0));
+		}
+		std::nth_element(ns.begin(), ns.begin() + ns.size() / 2, ns.end());
+		std::nth_element(cycles.begin(), cycles.begin() + cycles.size() / 2, cycles.end());
+		return {ns[ns.size() / 2], cycles[cycles.size() / 2]};
+	}
+
+	/// Copy bandwidth in bytes per nanosecond (read plus written) of a buffer much larger than the caches
+	double memoryBandwidth()
+	{
+		const size_t size = size_t(256) << 20;
+		std::vector<uint8_t> src(size, 1), dst(size, 0);
+		const Measurement m = measure([&] { memcpy(dst.data(), src.data(), size); }, 1.0);
+		return 2.0 * size / m.ns;
+	}
+
+	/// ARGB frame with a convex sector in the alpha channel and speckle in the color channels
+	void fillFrame(std::vector<uint8_t>& argb, int width, int height)
+	{
+		uint32_t state = 2463534242u;
+		for (int y = 0; y < height; y++)
+			for (int x = 0; x < width; x++)
+			{
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				const double dx = x - 0.5 * width, dy = y + 0.3 * height;
+				const bool inside = std::abs(dx) < 0.6 * dy;
+				uint8_t* p = argb.data() + (static_cast<size_t>(y) * width + x) * 4;
+				p[0] = p[1] = p[2] = inside ? static_cast<uint8_t>(state) : 0;
+				p[3] = inside ? 255 : 0;
+			}
+	}
+}
+
+
+int main(int argc, char** argv)
+{
+	std::string outputPath;
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		if (arg == "--output" && i + 1 < argc)
+			outputPath = argv[++i];
+		else
+		{
+			std::cerr << "Usage: " << argv[0] << " [--output <file>]" << std::endl;
+			return 1;
+		}
+	}
+
+	const double bandwidth = memoryBandwidth();
+	std::cerr << "Memory bandwidth: " << bandwidth << " GB/s (memcpy, read + write), kernels use " << ClariusKernels::simdLevel() << std::endl;
+
+	const std::vector<std::pair<int, int>> sizes = {{320, 240}, {640, 480}, {1024, 768}, {1280, 960}, {1920, 1440}};
+
+	std::ostringstream json;
+	json << std::fixed << std::setprecision(3);
+	json << "{\n  \"memoryBandwidthGBs\": " << bandwidth << ",\n  \"simd\": \"" << ClariusKernels::simdLevel() << "\",\n  \"kernels\": [\n";
+	bool first = true;
+	for (const auto& size : sizes)
+	{
+		const int width = size.first;
+		const int height = size.second;
+		const size_t numPixels = static_cast<size_t>(width) * height;
+
+		std::vector<uint8_t> argb(numPixels * 4), copy(numPixels * 4), mask(numPixels), gray(numPixels);
+		fillFrame(argb, width, height);
+		ClariusKernels::extractAlpha(argb.data(), numPixels, mask.data());
+		auto image = std::make_unique<TypedImage<unsigned char>>(ImageDescriptor(PixelType::UByte, vec3i(width, height, 1), 4));
+		memcpy(image->pointer(), argb.data(), argb.size());
+
+		volatile unsigned int sink = 0;
+		struct Kernel
+		{
+			std::string name;
+			size_t bytes;
+			std::function<void()> run;
+		};
+		const std::vector<Kernel> kernels = {
+			{"extractAlpha", numPixels * 5, [&] { ClariusKernels::extractAlpha(argb.data(), numPixels, mask.data()); }},
+			{"maskHash", numPixels, [&] { sink = ClariusKernels::maskHash(mask.data(), numPixels); }},
+			{"alphaSignature", numPixels * 4, [&] { sink = ClariusKernels::alphaSignature(argb.data(), numPixels); }},
+			{"accumulateNonZero", numPixels * 6, [&] { ClariusKernels::accumulateNonZero(argb.data(), numPixels, 4, mask.data()); }},
+			{"argbCopy", numPixels * 8, [&] { memcpy(copy.data(), argb.data(), argb.size()); }},
+			{"createGrayscale", numPixels * 5, [&] { auto gray = ImageProcessing::createGrayscale(*image, 3); }},
+			{"argbToGray", numPixels * 5, [&] { sink = ClariusKernels::argbToGray(argb.data(), numPixels, gray.data(), nullptr); }},
+			{"argbToGrayWithMask", numPixels * 6, [&] { sink = ClariusKernels::argbToGray(argb.data(), numPixels, gray.data(), mask.data()); }},
+			{"boxDownsample2", numPixels + numPixels / 4, [&] { ClariusKernels::boxDownsample(gray.data(), width, height, 2, copy.data()); }},
+			{"boxDownsample4", numPixels + numPixels / 16, [&] { ClariusKernels::boxDownsample(gray.data(), width, height, 4, copy.data()); }},
+		};
+
+		for (const Kernel& kernel : kernels)
+		{
+			const Measurement m = measure(kernel.run);
+			const double gbs = kernel.bytes / m.ns;
+			const double bytesPerCycle = m.cycles > 0.0 ? kernel.bytes / m.cycles : 0.0;
+			std::cerr << width << "x" << height << " " << kernel.name << ": " << m.ns * 1.e-6 << " ms, " << gbs << " GB/s ("
+					  << 100.0 * gbs / bandwidth << "% of memcpy), " << bytesPerCycle << " bytes/cycle" << std::endl;
+
+			json << (first ? "" : ",\n") << "    {\"kernel\": \"" << kernel.name << "\", \"width\": " << width << ", \"height\": " << height
+				 << ", \"bytes\": " << kernel.bytes << ", \"ms\": " << m.ns * 1.e-6 << ", \"GBs\": " << gbs
+				 << ", \"fractionOfBandwidth\": " << gbs / bandwidth << ", \"bytesPerCycle\": " << bytesPerCycle << "}";
+			first = false;
+		}
+	}
+	json << "\n  ]\n}\n";
+
+	if (outputPath.empty())
+		std::cout << json.str();
+	else
+	{
+		std::ofstream file(outputPath);
+		file << json.str();
+		if (!file)
+		{
+			std::cerr << "Could not write " << outputPath << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
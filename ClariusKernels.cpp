@@ -0,0 +1,537 @@
+#include "ClariusKernels.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#	define CLARIUS_KERNELS_X86
+#	define CLARIUS_TARGET_AVX2 __attribute__((target("avx2")))
+#	include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#	define CLARIUS_KERNELS_X86
+#	define CLARIUS_TARGET_AVX2
+#	include <immintrin.h>
+#	include <intrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#	define CLARIUS_KERNELS_NEON
+#	include <arm_neon.h>
+#endif
+
+namespace ImFusion
+{
+	namespace ClariusKernels
+	{
+		namespace
+		{
+			/// The signature is an FNV-1a hash over 16-bit words, each holding the opacity bits of 16 consecutive pixels
+			const unsigned int signatureSeed = 2166136261u;
+
+			inline unsigned int combine(unsigned int h, unsigned int bits) { return (h ^ bits) * 16777619u; }
+
+			/// Opacity bits of up to 16 pixels, bit i is set if pixel i is fully opaque
+			inline unsigned int opaqueBits(const uint8_t* argb, size_t count)
+			{
+				unsigned int bits = 0;
+				for (size_t i = 0; i < count; i++)
+					bits |= (argb[i * 4 + 3] == 255 ? 1u : 0u) << i;
+				return bits;
+			}
+
+			unsigned int alphaSignatureScalar(const uint8_t* argb, size_t numPixels)
+			{
+				unsigned int h = signatureSeed;
+				for (size_t i = 0; i < numPixels; i += 16)
+					h = combine(h, opaqueBits(argb + i * 4, std::min<size_t>(16, numPixels - i)));
+				return h ^ static_cast<unsigned int>(numPixels);
+			}
+
+			void extractAlphaScalar(const uint8_t* argb, size_t numPixels, uint8_t* mask)
+			{
+				for (size_t i = 0; i < numPixels; i++)
+					mask[i] = argb[i * 4 + 3];
+			}
+
+			/// Luma weights of the blue, green and red channel in 1/256, they sum up to 256
+			const int grayB = 29;
+			const int grayG = 150;
+			const int grayR = 77;
+
+			void grayScalar(const uint8_t* argb, size_t numPixels, uint8_t* gray)
+			{
+				for (size_t i = 0; i < numPixels; i++)
+					gray[i] = static_cast<uint8_t>((argb[i * 4] * grayB + argb[i * 4 + 1] * grayG + argb[i * 4 + 2] * grayR + 128) >> 8);
+			}
+
+			/// Converts up to 15 remaining pixels and adds their opacity bits to the signature
+			unsigned int argbToGrayTail(const uint8_t* argb, size_t numPixels, uint8_t* gray, uint8_t* mask, unsigned int h)
+			{
+				if (numPixels == 0)
+					return h;
+				grayScalar(argb, numPixels, gray);
+				if (mask)
+					extractAlphaScalar(argb, numPixels, mask);
+				return combine(h, opaqueBits(argb, numPixels));
+			}
+
+			unsigned int argbToGrayScalar(const uint8_t* argb, size_t numPixels, uint8_t* gray, uint8_t* mask)
+			{
+				unsigned int h = signatureSeed;
+				size_t i = 0;
+				for (; i + 16 <= numPixels; i += 16)
+					h = argbToGrayTail(argb + i * 4, 16, gray + i, mask ? mask + i : nullptr, h);
+				h = argbToGrayTail(argb + i * 4, numPixels - i, gray + i, mask ? mask + i : nullptr, h);
+				return h ^ static_cast<unsigned int>(numPixels);
+			}
+
+			void boxDownsampleScalar(const uint8_t* image, int width, int height, int factor, uint8_t* output)
+			{
+				const int outWidth = width / factor;
+				const int outHeight = height / factor;
+				const unsigned int area = static_cast<unsigned int>(factor * factor);
+				std::vector<unsigned int> sums(outWidth);
+				for (int y = 0; y < outHeight; y++)
+				{
+					std::fill(sums.begin(), sums.end(), 0u);
+					for (int r = 0; r < factor; r++)
+					{
+						const uint8_t* row = image + static_cast<size_t>(y * factor + r) * width;
+						for (int x = 0; x < outWidth; x++)
+							for (int c = 0; c < factor; c++)
+								sums[x] += row[x * factor + c];
+					}
+					uint8_t* out = output + static_cast<size_t>(y) * outWidth;
+					for (int x = 0; x < outWidth; x++)
+						out[x] = static_cast<uint8_t>((sums[x] + area / 2) / area);
+				}
+			}
+
+			/// Largest factor whose column sums of 8-bit pixels fit into 16 bits, larger factors use boxDownsampleScalar()
+			const int maxColumnFactor = 16;
+
+			/// Adds up numRows rows of count pixels each into columns, the rows are stride bytes apart
+			using AccumulateRows = void (*)(const uint8_t* rows, size_t stride, int numRows, int count, uint16_t* columns);
+
+			void accumulateRowsScalar(const uint8_t* rows, size_t stride, int numRows, int count, uint16_t* columns)
+			{
+				for (int x = 0; x < count; x++)
+				{
+					unsigned int sum = 0;
+					for (int r = 0; r < numRows; r++)
+						sum += rows[r * stride + x];
+					columns[x] = static_cast<uint16_t>(sum);
+				}
+			}
+
+			/// Box filter in two passes, a vectorized vertical sum of factor rows into 16-bit columns followed by adding up
+			/// factor columns per output pixel, which touches factor times fewer values
+			void boxDownsampleColumns(AccumulateRows accumulate, const uint8_t* image, int width, int height, int factor, uint8_t* output)
+			{
+				if (factor > maxColumnFactor)
+					return boxDownsampleScalar(image, width, height, factor, output);
+				const int outWidth = width / factor;
+				const int outHeight = height / factor;
+				const unsigned int area = static_cast<unsigned int>(factor * factor);
+				// exact rounded division by multiplication, the sums stay far below 2^32 / area
+				const uint64_t reciprocal = (uint64_t(1) << 32) / area + 1;
+				thread_local std::vector<uint16_t> columns;
+				columns.resize(static_cast<size_t>(outWidth) * factor);
+				for (int y = 0; y < outHeight; y++)
+				{
+					accumulate(image + static_cast<size_t>(y) * factor * width, width, factor, outWidth * factor, columns.data());
+					const uint16_t* column = columns.data();
+					uint8_t* out = output + static_cast<size_t>(y) * outWidth;
+					for (int x = 0; x < outWidth; x++, column += factor)
+					{
+						unsigned int sum = area / 2;
+						for (int c = 0; c < factor; c++)
+							sum += column[c];
+						out[x] = static_cast<uint8_t>((sum * reciprocal) >> 32);
+					}
+				}
+			}
+
+#ifdef CLARIUS_KERNELS_X86
+			/// Alpha bytes of 16 consecutive pixels
+			inline __m128i alpha16(const uint8_t* argb)
+			{
+				const __m128i a = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(argb)), 24);
+				const __m128i b = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(argb + 16)), 24);
+				const __m128i c = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(argb + 32)), 24);
+				const __m128i d = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(argb + 48)), 24);
+				return _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+			}
+
+			/// Gray values of 4 consecutive pixels as 32-bit integers
+			inline __m128i gray4(__m128i pixels)
+			{
+				const __m128i zero = _mm_setzero_si128();
+				const __m128i weights = _mm_setr_epi16(grayB, grayG, grayR, 0, grayB, grayG, grayR, 0);
+				// per pixel b * wb + g * wg and r * wr, the odd 32-bit element is added to the even one
+				__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), weights);
+				__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), weights);
+				lo = _mm_shuffle_epi32(_mm_add_epi32(lo, _mm_srli_epi64(lo, 32)), _MM_SHUFFLE(3, 1, 2, 0));
+				hi = _mm_shuffle_epi32(_mm_add_epi32(hi, _mm_srli_epi64(hi, 32)), _MM_SHUFFLE(3, 1, 2, 0));
+				return _mm_srli_epi32(_mm_add_epi32(_mm_unpacklo_epi64(lo, hi), _mm_set1_epi32(128)), 8);
+			}
+
+			/// Gray values of 16 consecutive pixels
+			inline __m128i gray16(const uint8_t* argb)
+			{
+				const __m128i a = gray4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(argb)));
+				const __m128i b = gray4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(argb + 16)));
+				const __m128i c = gray4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(argb + 32)));
+				const __m128i d = gray4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(argb + 48)));
+				return _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+			}
+
+			unsigned int argbToGraySse2(const uint8_t* argb, size_t numPixels, uint8_t* gray, uint8_t* mask)
+			{
+				const __m128i opaque = _mm_set1_epi8(-1);
+				unsigned int h = signatureSeed;
+				size_t i = 0;
+				for (; i + 16 <= numPixels; i += 16)
+				{
+					const __m128i alpha = alpha16(argb + i * 4);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(gray + i), gray16(argb + i * 4));
+					if (mask)
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(mask + i), alpha);
+					h = combine(h, static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(alpha, opaque))));
+				}
+				h = argbToGrayTail(argb + i * 4, numPixels - i, gray + i, mask ? mask + i : nullptr, h);
+				return h ^ static_cast<unsigned int>(numPixels);
+			}
+
+			unsigned int alphaSignatureSse2(const uint8_t* argb, size_t numPixels)
+			{
+				const __m128i opaque = _mm_set1_epi8(-1);
+				unsigned int h = signatureSeed;
+				size_t i = 0;
+				for (; i + 16 <= numPixels; i += 16)
+					h = combine(h, static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(alpha16(argb + i * 4), opaque))));
+				if (i < numPixels)
+					h = combine(h, opaqueBits(argb + i * 4, numPixels - i));
+				return h ^ static_cast<unsigned int>(numPixels);
+			}
+
+			void extractAlphaSse2(const uint8_t* argb, size_t numPixels, uint8_t* mask)
+			{
+				size_t i = 0;
+				for (; i + 16 <= numPixels; i += 16)
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(mask + i), alpha16(argb + i * 4));
+				extractAlphaScalar(argb + i * 4, numPixels - i, mask + i);
+			}
+
+			/// Alpha bytes of 32 consecutive pixels in pixel order
+			CLARIUS_TARGET_AVX2 inline __m256i alpha32(const uint8_t* argb)
+			{
+				const __m256i a = _mm256_srli_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(argb)), 24);
+				const __m256i b = _mm256_srli_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(argb + 32)), 24);
+				const __m256i c = _mm256_srli_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(argb + 64)), 24);
+				const __m256i d = _mm256_srli_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(argb + 96)), 24);
+				// packing works within 128-bit lanes, the permutation restores the pixel order of the 4-pixel groups
+				const __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+				return _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+			}
+
+			/// Gray values of 8 consecutive pixels as 32-bit integers
+			CLARIUS_TARGET_AVX2 inline __m256i gray8(__m256i pixels)
+			{
+				const __m256i zero = _mm256_setzero_si256();
+				const __m256i weights = _mm256_setr_epi16(grayB, grayG, grayR, 0, grayB, grayG, grayR, 0, grayB, grayG, grayR, 0, grayB, grayG, grayR, 0);
+				// as gray4() within each 128-bit lane, which holds 4 consecutive pixels
+				__m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(pixels, zero), weights);
+				__m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(pixels, zero), weights);
+				lo = _mm256_shuffle_epi32(_mm256_add_epi32(lo, _mm256_srli_epi64(lo, 32)), _MM_SHUFFLE(3, 1, 2, 0));
+				hi = _mm256_shuffle_epi32(_mm256_add_epi32(hi, _mm256_srli_epi64(hi, 32)), _MM_SHUFFLE(3, 1, 2, 0));
+				return _mm256_srli_epi32(_mm256_add_epi32(_mm256_unpacklo_epi64(lo, hi), _mm256_set1_epi32(128)), 8);
+			}
+
+			/// Gray values of 32 consecutive pixels in pixel order
+			CLARIUS_TARGET_AVX2 inline __m256i gray32(const uint8_t* argb)
+			{
+				const __m256i a = gray8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(argb)));
+				const __m256i b = gray8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(argb + 32)));
+				const __m256i c = gray8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(argb + 64)));
+				const __m256i d = gray8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(argb + 96)));
+				const __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+				return _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+			}
+
+			CLARIUS_TARGET_AVX2 unsigned int argbToGrayAvx2(const uint8_t* argb, size_t numPixels, uint8_t* gray, uint8_t* mask)
+			{
+				const __m256i opaque = _mm256_set1_epi8(-1);
+				unsigned int h = signatureSeed;
+				size_t i = 0;
+				for (; i + 32 <= numPixels; i += 32)
+				{
+					const __m256i alpha = alpha32(argb + i * 4);
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(gray + i), gray32(argb + i * 4));
+					if (mask)
+						_mm256_storeu_si256(reinterpret_cast<__m256i*>(mask + i), alpha);
+					const unsigned int bits = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(alpha, opaque)));
+					h = combine(combine(h, bits & 0xffff), bits >> 16);
+				}
+				for (; i < numPixels; i += 16)
+					h = argbToGrayTail(argb + i * 4, std::min<size_t>(16, numPixels - i), gray + i, mask ? mask + i : nullptr, h);
+				return h ^ static_cast<unsigned int>(numPixels);
+			}
+
+			CLARIUS_TARGET_AVX2 unsigned int alphaSignatureAvx2(const uint8_t* argb, size_t numPixels)
+			{
+				const __m256i opaque = _mm256_set1_epi8(-1);
+				unsigned int h = signatureSeed;
+				size_t i = 0;
+				for (; i + 32 <= numPixels; i += 32)
+				{
+					const unsigned int bits = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(alpha32(argb + i * 4), opaque)));
+					h = combine(combine(h, bits & 0xffff), bits >> 16);
+				}
+				for (; i < numPixels; i += 16)
+					h = combine(h, opaqueBits(argb + i * 4, std::min<size_t>(16, numPixels - i)));
+				return h ^ static_cast<unsigned int>(numPixels);
+			}
+
+			CLARIUS_TARGET_AVX2 void extractAlphaAvx2(const uint8_t* argb, size_t numPixels, uint8_t* mask)
+			{
+				size_t i = 0;
+				for (; i + 32 <= numPixels; i += 32)
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(mask + i), alpha32(argb + i * 4));
+				extractAlphaScalar(argb + i * 4, numPixels - i, mask + i);
+			}
+
+			void accumulateRowsSse2(const uint8_t* rows, size_t stride, int numRows, int count, uint16_t* columns)
+			{
+				const __m128i zero = _mm_setzero_si128();
+				int x = 0;
+				for (; x + 16 <= count; x += 16)
+				{
+					__m128i lo = zero, hi = zero;
+					for (int r = 0; r < numRows; r++)
+					{
+						const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows + r * stride + x));
+						lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+						hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+					}
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(columns + x), lo);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(columns + x + 8), hi);
+				}
+				accumulateRowsScalar(rows + x, stride, numRows, count - x, columns + x);
+			}
+
+			void boxDownsampleSse2(const uint8_t* image, int width, int height, int factor, uint8_t* output)
+			{
+				boxDownsampleColumns(accumulateRowsSse2, image, width, height, factor, output);
+			}
+
+			CLARIUS_TARGET_AVX2 void accumulateRowsAvx2(const uint8_t* rows, size_t stride, int numRows, int count, uint16_t* columns)
+			{
+				const __m256i zero = _mm256_setzero_si256();
+				int x = 0;
+				for (; x + 32 <= count; x += 32)
+				{
+					// unpacking works within 128-bit lanes, lo holds pixels 0-7 and 16-23, hi pixels 8-15 and 24-31
+					__m256i lo = zero, hi = zero;
+					for (int r = 0; r < numRows; r++)
+					{
+						const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows + r * stride + x));
+						lo = _mm256_add_epi16(lo, _mm256_unpacklo_epi8(v, zero));
+						hi = _mm256_add_epi16(hi, _mm256_unpackhi_epi8(v, zero));
+					}
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(columns + x), _mm256_permute2x128_si256(lo, hi, 0x20));
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(columns + x + 16), _mm256_permute2x128_si256(lo, hi, 0x31));
+				}
+				accumulateRowsSse2(rows + x, stride, numRows, count - x, columns + x);
+			}
+
+			CLARIUS_TARGET_AVX2 void boxDownsampleAvx2(const uint8_t* image, int width, int height, int factor, uint8_t* output)
+			{
+				boxDownsampleColumns(accumulateRowsAvx2, image, width, height, factor, output);
+			}
+
+			bool cpuHasAvx2()
+			{
+#	if defined(_MSC_VER)
+				int info[4];
+				__cpuid(info, 1);
+				const bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+				__cpuidex(info, 7, 0);
+				return osSavesYmm && (info[1] & (1 << 5));
+#	else
+				return __builtin_cpu_supports("avx2");
+#	endif
+			}
+#endif
+
+#ifdef CLARIUS_KERNELS_NEON
+			inline unsigned int opaqueBitsNeon(const uint8_t* argb)
+			{
+				static const uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+				const uint8x16_t opaque = vceqq_u8(vld4q_u8(argb).val[3], vdupq_n_u8(255));
+				const uint8x16_t weighted = vandq_u8(opaque, vld1q_u8(weights));
+				return vaddv_u8(vget_low_u8(weighted)) | (static_cast<unsigned int>(vaddv_u8(vget_high_u8(weighted))) << 8);
+			}
+
+			unsigned int alphaSignatureNeon(const uint8_t* argb, size_t numPixels)
+			{
+				unsigned int h = signatureSeed;
+				size_t i = 0;
+				for (; i + 16 <= numPixels; i += 16)
+					h = combine(h, opaqueBitsNeon(argb + i * 4));
+				if (i < numPixels)
+					h = combine(h, opaqueBits(argb + i * 4, numPixels - i));
+				return h ^ static_cast<unsigned int>(numPixels);
+			}
+
+			unsigned int argbToGrayNeon(const uint8_t* argb, size_t numPixels, uint8_t* gray, uint8_t* mask)
+			{
+				unsigned int h = signatureSeed;
+				size_t i = 0;
+				for (; i + 16 <= numPixels; i += 16)
+				{
+					const uint8x16x4_t bgra = vld4q_u8(argb + i * 4);
+					uint16x8_t lo = vmull_u8(vget_low_u8(bgra.val[0]), vdup_n_u8(grayB));
+					uint16x8_t hi = vmull_u8(vget_high_u8(bgra.val[0]), vdup_n_u8(grayB));
+					lo = vmlal_u8(lo, vget_low_u8(bgra.val[1]), vdup_n_u8(grayG));
+					hi = vmlal_u8(hi, vget_high_u8(bgra.val[1]), vdup_n_u8(grayG));
+					lo = vmlal_u8(lo, vget_low_u8(bgra.val[2]), vdup_n_u8(grayR));
+					hi = vmlal_u8(hi, vget_high_u8(bgra.val[2]), vdup_n_u8(grayR));
+					vst1q_u8(gray + i, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+					if (mask)
+						vst1q_u8(mask + i, bgra.val[3]);
+					h = combine(h, opaqueBitsNeon(argb + i * 4));
+				}
+				h = argbToGrayTail(argb + i * 4, numPixels - i, gray + i, mask ? mask + i : nullptr, h);
+				return h ^ static_cast<unsigned int>(numPixels);
+			}
+
+			void extractAlphaNeon(const uint8_t* argb, size_t numPixels, uint8_t* mask)
+			{
+				size_t i = 0;
+				for (; i + 16 <= numPixels; i += 16)
+					vst1q_u8(mask + i, vld4q_u8(argb + i * 4).val[3]);
+				extractAlphaScalar(argb + i * 4, numPixels - i, mask + i);
+			}
+
+			void accumulateRowsNeon(const uint8_t* rows, size_t stride, int numRows, int count, uint16_t* columns)
+			{
+				int x = 0;
+				for (; x + 16 <= count; x += 16)
+				{
+					uint16x8_t lo = vdupq_n_u16(0), hi = vdupq_n_u16(0);
+					for (int r = 0; r < numRows; r++)
+					{
+						const uint8x16_t v = vld1q_u8(rows + r * stride + x);
+						lo = vaddw_u8(lo, vget_low_u8(v));
+						hi = vaddw_high_u8(hi, v);
+					}
+					vst1q_u16(columns + x, lo);
+					vst1q_u16(columns + x + 8, hi);
+				}
+				accumulateRowsScalar(rows + x, stride, numRows, count - x, columns + x);
+			}
+
+			void boxDownsampleNeon(const uint8_t* image, int width, int height, int factor, uint8_t* output)
+			{
+				boxDownsampleColumns(accumulateRowsNeon, image, width, height, factor, output);
+			}
+#endif
+
+			/// Implementations selected once for the executing CPU
+			struct Dispatch
+			{
+				Dispatch()
+				{
+#if defined(CLARIUS_KERNELS_X86)
+					if (cpuHasAvx2())
+					{
+						alphaSignature = alphaSignatureAvx2;
+						extractAlpha = extractAlphaAvx2;
+						argbToGray = argbToGrayAvx2;
+						boxDownsample = boxDownsampleAvx2;
+						level = "AVX2";
+					}
+					else
+					{
+						alphaSignature = alphaSignatureSse2;
+						extractAlpha = extractAlphaSse2;
+						argbToGray = argbToGraySse2;
+						boxDownsample = boxDownsampleSse2;
+						level = "SSE2";
+					}
+#elif defined(CLARIUS_KERNELS_NEON)
+					alphaSignature = alphaSignatureNeon;
+					extractAlpha = extractAlphaNeon;
+					argbToGray = argbToGrayNeon;
+					boxDownsample = boxDownsampleNeon;
+					level = "NEON";
+#endif
+				}
+
+				unsigned int (*alphaSignature)(const uint8_t*, size_t) = alphaSignatureScalar;
+				void (*extractAlpha)(const uint8_t*, size_t, uint8_t*) = extractAlphaScalar;
+				unsigned int (*argbToGray)(const uint8_t*, size_t, uint8_t*, uint8_t*) = argbToGrayScalar;
+				void (*boxDownsample)(const uint8_t*, int, int, int, uint8_t*) = boxDownsampleScalar;
+				const char* level = "scalar";
+			};
+
+			const Dispatch& dispatch()
+			{
+				static const Dispatch d;
+				return d;
+			}
+		}
+
+
+		void extractAlpha(const uint8_t* argb, size_t numPixels, uint8_t* mask) { dispatch().extractAlpha(argb, numPixels, mask); }
+
+
+		unsigned int maskHash(const uint8_t* mask, size_t numPixels)
+		{
+			int h = 0;
+			for (int i = 0; i < static_cast<int>(numPixels); i++)
+				h = h * 33 + ((mask[i] == 255) * i) % 701;
+			return h;
+		}
+
+
+		unsigned int alphaSignature(const uint8_t* argb, size_t numPixels) { return dispatch().alphaSignature(argb, numPixels); }
+
+
+		unsigned int argbToGray(const uint8_t* argb, size_t numPixels, uint8_t* gray, uint8_t* mask)
+		{
+			return dispatch().argbToGray(argb, numPixels, gray, mask);
+		}
+
+
+		const char* simdLevel() { return dispatch().level; }
+
+
+		void copyRect(const uint8_t* image, int imageWidth, int channels, int x, int y, int width, int height, uint8_t* output)
+		{
+			const size_t rowBytes = static_cast<size_t>(width) * channels;
+			for (int r = 0; r < height; r++)
+				memcpy(output + r * rowBytes, image + (static_cast<size_t>(y + r) * imageWidth + x) * channels, rowBytes);
+		}
+
+
+		void boxDownsample(const uint8_t* image, int width, int height, int factor, uint8_t* output)
+		{
+			if (factor >= 1)
+				dispatch().boxDownsample(image, width, height, factor, output);
+		}
+
+
+		void accumulateNonZero(const uint8_t* image, size_t numPixels, int channels, uint8_t* mask)
+		{
+			const int colorChannels = std::min(channels, 3);
+			for (size_t i = 0; i < numPixels; i++)
+			{
+				uint8_t value = 0;
+				for (int c = 0; c < colorChannels; c++)
+					value |= image[i * channels + c];
+				mask[i] |= value > 0 ? 255 : 0;
+			}
+		}
+	}
+}
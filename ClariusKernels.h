@@ -0,0 +1,41 @@
+/* Copyright (c) 2012-2019 ImFusion GmbH, Munich, Germany. All rights reserved. */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ImFusion
+{
+	/// Per-frame image kernels of the Clarius image callback, kept separate so that they can be benchmarked in isolation
+	namespace ClariusKernels
+	{
+		/// Copies the alpha channel of an ARGB (BGRA in memory) image into a mask
+		void extractAlpha(const uint8_t* argb, size_t numPixels, uint8_t* mask);
+
+		/// Signature of a mask, changes whenever the set of fully opaque pixels changes
+		unsigned int maskHash(const uint8_t* mask, size_t numPixels);
+
+		/// Signature of the fully opaque pixels of an ARGB (BGRA in memory) image, computed in a single pass without a mask
+		/// Uses AVX2, SSE2 or NEON if available at runtime; all code paths yield the same value.
+		unsigned int alphaSignature(const uint8_t* argb, size_t numPixels);
+
+		/// Converts an ARGB (BGRA in memory) image to 8-bit gray and returns its alphaSignature(), in a single pass
+		/// Gray values use the integer Rec. 601 luma weights, so that pixels with equal color channels keep their value. If
+		/// mask is not null, the alpha channel is copied into it as by extractAlpha().
+		unsigned int argbToGray(const uint8_t* argb, size_t numPixels, uint8_t* gray, uint8_t* mask);
+
+		/// Name of the instruction set used by alphaSignature(), extractAlpha(), argbToGray() and boxDownsample() on this machine
+		const char* simdLevel();
+
+		/// Copies a rectangle of width x height pixels at (x, y) of an interleaved 8-bit image into a tightly packed output
+		void copyRect(const uint8_t* image, int imageWidth, int channels, int x, int y, int width, int height, uint8_t* output);
+
+		/// Averages blocks of factor x factor pixels of an 8-bit single channel image with rounding
+		/// The output has width / factor x height / factor pixels, remaining rows and columns are ignored.
+		/// Uses AVX2, SSE2 or NEON if available at runtime for factors up to 16; all code paths yield the same values.
+		void boxDownsample(const uint8_t* image, int width, int height, int factor, uint8_t* output);
+
+		/// Sets all mask pixels to 255 whose color channels are not all zero, the alpha channel of 4-channel images is ignored
+		void accumulateNonZero(const uint8_t* image, size_t numPixels, int channels, uint8_t* mask);
+	}
+}
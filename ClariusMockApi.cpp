@@ -0,0 +1,556 @@
+#include "ClariusMockApi.h"
+
+#include <ImFusion/Base/IMUPoseIntegration.h>
+#include <ImFusion/Base/TypedImage.h>
+#include <ImFusion/Core/Log.h>
+
+#include <QImage>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <random>
+#include <sstream>
+
+#undef IMFUSION_LOG_DEFAULT_CATEGORY
+#define IMFUSION_LOG_DEFAULT_CATEGORY "ClariusMockApi"
+
+
+namespace ImFusion
+{
+	namespace
+	{
+		using Clock = std::chrono::steady_clock;
+
+		const double pi = 3.14159265358979323846;
+
+		/// Opening angle of the synthetic convex sector in radians
+		const double sectorAngle = pi / 3.0;
+
+		/// Radius of the synthetic convex probe in millimeters
+		const int convexRadius = 45;
+
+		/// Width of the synthetic linear field of view in millimeters
+		const double linearWidth = 38.0;
+
+		/// Cheap pseudo random numbers for speckle
+		inline uint32_t xorshift(uint32_t& state)
+		{
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return state;
+		}
+
+		/// Recorded frame, already converted to the transport format
+		struct ReplayFrame
+		{
+			unsigned long long timestamp = 0;
+			double micronsPerPixel = 0.0;
+			QImage image;
+		};
+	}
+
+
+	struct ClariusMockApi::Impl
+	{
+		explicit Impl(const Settings& settings)
+			: resolution(settings.resolution)
+			, depth(settings.depth)
+			, rng(settings.seed)
+		{
+		}
+
+		/// Sleeps until the given time, returns false if the thread is asked to stop
+		bool waitUntil(Clock::time_point time)
+		{
+			std::unique_lock<std::mutex> lock(threadMutex);
+			return !threadCondition.wait_until(lock, time, [this] { return stopExecution.load(); });
+		}
+
+		/// Stops the SDK thread if running
+		void stopThread()
+		{
+			{
+				std::lock_guard<std::mutex> lock(threadMutex);
+				stopExecution = true;
+			}
+			threadCondition.notify_all();
+			if (sdkThread.valid())
+				sdkThread.wait();
+			stopExecution = false;
+		}
+
+		std::future<void> sdkThread;               ///< Future wrapping the thread emulating the SDK thread
+		std::condition_variable threadCondition;    ///< Interrupts sleeps of the SDK thread on stop
+		std::mutex threadMutex;                     ///< Mutex protecting access to threadCondition
+		std::atomic<bool> stopExecution = {false};    ///< Flag whether to stop the SDK thread
+
+		std::mutex configMutex;    ///< Protects the imaging configuration below
+		vec2i resolution;
+		double depth;
+		double gain = 50.0;
+		ImageFormat format = ImageFormat::Argb;
+
+		std::mt19937 rng;                        ///< Only used by the SDK thread
+		uint32_t speckleState = 2463534242u;     ///< Only used by the SDK thread
+		std::vector<unsigned char> mask;         ///< Field of view of synthetic frames, only used by the SDK thread
+		vec2i maskSize = vec2i::Zero();
+		double maskDepth = 0.0;
+		std::atomic<size_t> framesSent = {0};
+
+		std::vector<ReplayFrame> replayFrames;         ///< Loaded on connect
+		std::vector<ClariusImuSample> replayImu;       ///< Loaded on connect, sorted by timestamp
+	};
+
+
+	ClariusMockApi::ClariusMockApi()
+		: ClariusMockApi(Settings())
+	{
+	}
+
+
+	ClariusMockApi::ClariusMockApi(const Settings& settings)
+		: m_pimpl(new Impl(settings))
+		, m_settings(settings)
+	{
+	}
+
+
+	ClariusMockApi::~ClariusMockApi() { m_pimpl->stopThread(); }
+
+
+	bool ClariusMockApi::init() { return true; }
+
+
+	bool ClariusMockApi::connect(const char* /*ipAddress*/, unsigned int /*port*/)
+	{
+		m_pimpl->stopThread();
+		m_pimpl->framesSent = 0;
+
+		ImageFormat format;
+		{
+			std::lock_guard<std::mutex> lock(m_pimpl->configMutex);
+			format = m_pimpl->format;
+		}
+
+		m_pimpl->replayFrames.clear();
+		m_pimpl->replayImu.clear();
+		if (!m_settings.replayPath.empty())
+		{
+			const std::string dir = m_settings.replayPath + "/";
+			std::ifstream frames(dir + "frames.txt");
+			if (!frames)
+			{
+				LOG_ERROR("Could not open recorded session " << dir << "frames.txt");
+				return false;
+			}
+			std::string line;
+			while (std::getline(frames, line))
+			{
+				std::istringstream ss(line);
+				ReplayFrame frame;
+				std::string file;
+				if (!(ss >> frame.timestamp >> file))
+					continue;
+				if (!(ss >> frame.micronsPerPixel))
+					frame.micronsPerPixel = 0.0;
+				if (!frame.image.load(QString::fromStdString(dir + file)))
+				{
+					LOG_WARN("Could not load recorded frame " << file);
+					continue;
+				}
+				frame.image = frame.image.convertToFormat(format == ImageFormat::Gray8 ? QImage::Format_Grayscale8 : QImage::Format_ARGB32);
+				if (frame.micronsPerPixel <= 0.0)
+					frame.micronsPerPixel = m_settings.depth * 1.e3 / frame.image.height();
+				m_pimpl->replayFrames.push_back(std::move(frame));
+			}
+			if (m_pimpl->replayFrames.empty())
+			{
+				LOG_ERROR("Recorded session " << m_settings.replayPath << " contains no frames");
+				return false;
+			}
+			std::sort(m_pimpl->replayFrames.begin(), m_pimpl->replayFrames.end(), [](const ReplayFrame& a, const ReplayFrame& b) {
+				return a.timestamp < b.timestamp;
+			});
+
+			std::ifstream imu(dir + "imu.txt");
+			while (std::getline(imu, line))
+			{
+				std::istringstream ss(line);
+				ClariusImuSample s;
+				double qw, qx, qy, qz;
+				if (ss >> s.timestamp >> s.gyro[0] >> s.gyro[1] >> s.gyro[2] >> s.linAcc[0] >> s.linAcc[1] >> s.linAcc[2] >> s.mag[0] >>
+					s.mag[1] >> s.mag[2] >> qw >> qx >> qy >> qz)
+				{
+					s.orientation = quat(qw, qx, qy, qz);
+					m_pimpl->replayImu.push_back(s);
+				}
+			}
+			std::sort(m_pimpl->replayImu.begin(), m_pimpl->replayImu.end(), [](const ClariusImuSample& a, const ClariusImuSample& b) {
+				return a.timestamp < b.timestamp;
+			});
+			LOG_INFO("Replaying " << m_pimpl->replayFrames.size() << " frames and " << m_pimpl->replayImu.size() << " IMU samples from "
+								  << m_settings.replayPath);
+		}
+
+		m_pimpl->sdkThread = std::async(std::launch::async, [this]() {
+			try
+			{
+				if (m_settings.replayPath.empty())
+					runSynthetic();
+				else
+					runReplay();
+			}
+			catch (std::exception& e)
+			{
+				LOG_ERROR("An unexpected exception occurred while running the background thread. " << e.what());
+			}
+		});
+		return true;
+	}
+
+
+	void ClariusMockApi::disconnect() { m_pimpl->stopThread(); }
+
+
+	void ClariusMockApi::destroy() { m_pimpl->stopThread(); }
+
+
+	bool ClariusMockApi::setGain(double gain)
+	{
+		std::lock_guard<std::mutex> lock(m_pimpl->configMutex);
+		m_pimpl->gain = std::min(std::max(gain, 0.0), 100.0);
+		return true;
+	}
+
+
+	bool ClariusMockApi::setDepth(double depth)
+	{
+		if (depth <= 0.0)
+			return false;
+		std::lock_guard<std::mutex> lock(m_pimpl->configMutex);
+		m_pimpl->depth = depth;
+		return true;
+	}
+
+
+	bool ClariusMockApi::setResolution(vec2i resolution)
+	{
+		if (resolution[0] <= 0 || resolution[1] <= 0)
+			return false;
+		std::lock_guard<std::mutex> lock(m_pimpl->configMutex);
+		m_pimpl->resolution = resolution;
+		return true;
+	}
+
+
+	bool ClariusMockApi::setImageFormat(ImageFormat format, int /*numDecodeThreads*/)
+	{
+		if (format != ImageFormat::Argb && format != ImageFormat::Gray8)
+			return false;
+		std::lock_guard<std::mutex> lock(m_pimpl->configMutex);
+		m_pimpl->format = format;
+		return true;
+	}
+
+
+	bool ClariusMockApi::probeInfo(ClariusProbeInfo& info)
+	{
+		info.version = 3;
+		info.elements = m_settings.rawSize[0];
+		info.pitch = static_cast<int>(std::lround((m_settings.convex ? convexRadius * sectorAngle : linearWidth) * 1.e3 / std::max(info.elements, 1)));
+		info.radius = m_settings.convex ? convexRadius : 0;
+		info.firmware = "mock";
+		return true;
+	}
+
+
+	size_t ClariusMockApi::numFramesSent() const { return m_pimpl->framesSent; }
+
+
+	void ClariusMockApi::runSynthetic()
+	{
+		const auto start = Clock::now();
+		const auto deviceTime = [start](Clock::time_point t) {
+			return static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(t - start).count());
+		};
+		const auto seconds = [](double s) { return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(s)); };
+
+		const auto framePeriod = seconds(1.0 / std::max(m_settings.fps, 1.e-3));
+		const auto imuPeriod = seconds(1.0 / std::max(m_settings.imuRate, 1.e-3));
+		const auto never = Clock::time_point::max();
+		std::uniform_real_distribution<double> jitter(-m_settings.jitterMs * 1.e-3, m_settings.jitterMs * 1.e-3);
+
+		auto nextFrame = start;
+		auto nextImu = m_settings.imuRate > 0.0 ? start : never;
+		auto nextButton = m_settings.buttonInterval > 0.0 ? start + seconds(m_settings.buttonInterval) : never;
+		auto nextFreeze = m_settings.freezeInterval > 0.0 ? start + seconds(m_settings.freezeInterval) : never;
+		int frameIndex = 0;
+		int burstRemaining = 0;
+		std::vector<ClariusImuSample> bundle;    // IMU samples since the last frame
+		bundle.reserve(64);
+
+		while (m_pimpl->waitUntil(std::min({nextFrame, nextImu, nextButton, nextFreeze})))
+		{
+			const auto now = Clock::now();
+			if (now >= nextFreeze)
+			{
+				if (freezeCallback)
+					freezeCallback(true);
+				if (!m_pimpl->waitUntil(now + seconds(m_settings.freezeDuration)))
+					break;
+				if (freezeCallback)
+					freezeCallback(false);
+				// no data while frozen, the IMU samples of the freeze are not bundled with the next frame
+				const auto resume = Clock::now();
+				nextFreeze = resume + seconds(m_settings.freezeInterval);
+				nextFrame = resume;
+				nextImu = nextImu == never ? never : resume;
+				bundle.clear();
+				continue;
+			}
+			if (now >= nextButton)
+			{
+				if (buttonCallback)
+					buttonCallback(0, 1);
+				nextButton += seconds(m_settings.buttonInterval);
+			}
+			if (now >= nextImu)
+			{
+				// slow sweeping motion of the probe
+				const double t = std::chrono::duration<double>(nextImu - start).count();
+				ClariusImuSample sample;
+				sample.timestamp = deviceTime(nextImu);
+				sample.orientation = quat(Eigen::AngleAxisd(0.5 * std::sin(0.5 * t), vec3::UnitX()));
+				sample.gyro = vec3(0.25 * std::cos(0.5 * t), 0.0, 0.0);
+				sample.linAcc = sample.orientation.inverse() * vec3(0.0, 0.0, 1.0);
+				sample.mag = sample.orientation.inverse() * vec3(1.0, 0.0, 0.0);
+				if (imuCallback)
+					imuCallback(sample);
+				if (bundle.size() < bundle.capacity())
+					bundle.push_back(sample);
+				nextImu += imuPeriod;
+			}
+			if (now >= nextFrame)
+			{
+				sendSyntheticFrame(deviceTime(now), frameIndex, bundle);
+				bundle.clear();
+
+				if (m_settings.burstInterval > 0 && ++frameIndex % m_settings.burstInterval == 0)
+					burstRemaining = std::max(m_settings.burstSize - 1, 0);
+				if (burstRemaining > 0)
+				{
+					burstRemaining--;
+					nextFrame = now;
+				}
+				else
+				{
+					nextFrame += framePeriod + seconds(jitter(m_pimpl->rng));
+					if (nextFrame < now - framePeriod)
+						nextFrame = now;    // do not try to catch up after a stall
+				}
+			}
+		}
+	}
+
+
+	void ClariusMockApi::sendSyntheticFrame(unsigned long long timestamp, int frameIndex, const std::vector<ClariusImuSample>& imuSamples)
+	{
+		vec2i resolution;
+		double depth, gain;
+		ImageFormat format;
+		{
+			std::lock_guard<std::mutex> lock(m_pimpl->configMutex);
+			resolution = m_pimpl->resolution;
+			depth = m_pimpl->depth;
+			gain = m_pimpl->gain;
+			format = m_pimpl->format;
+		}
+		const int width = resolution[0];
+		const int height = resolution[1];
+		const double pixelSize = depth / height;    // mm
+		const double fieldWidth = m_settings.convex ? 2.0 * (convexRadius + depth) * std::sin(sectorAngle / 2) : linearWidth;
+
+		if (m_pimpl->maskSize != resolution || m_pimpl->maskDepth != depth)
+		{
+			// the field of view matches the probe reported by probeInfo(), its size in pixels changes with resolution and depth
+			m_pimpl->mask.assign(static_cast<size_t>(width) * height, 0);
+			const double apex = m_settings.convex ? convexRadius / pixelSize : 0.0;
+			for (int y = 0; y < height; y++)
+				for (int x = 0; x < width; x++)
+				{
+					bool inside;
+					if (m_settings.convex)
+					{
+						const double dx = x + 0.5 - 0.5 * width;
+						const double dy = y + 0.5 + apex;
+						const double r = std::sqrt(dx * dx + dy * dy);
+						inside = r >= apex && r <= apex + height && std::abs(std::atan2(dx, dy)) <= sectorAngle / 2;
+					}
+					else
+						inside = std::abs(x + 0.5 - 0.5 * width) * pixelSize <= linearWidth / 2;
+					m_pimpl->mask[static_cast<size_t>(y) * width + x] = inside ? 255 : 0;
+				}
+			m_pimpl->maskSize = resolution;
+			m_pimpl->maskDepth = depth;
+		}
+
+		if (measuresCallback)
+			measuresCallback(depth, fieldWidth);
+
+		// speckle with depth attenuation and a bright reflector moving through the image
+		const int channels = format == ImageFormat::Gray8 ? 1 : 4;
+		auto img = framePool().acquireImage<unsigned char>(width, height, channels);
+		const int band = (frameIndex * 4) % height;
+		const double brightness = 0.5 + gain / 100.0;
+		uint32_t& state = m_pimpl->speckleState;
+		for (int y = 0; y < height; y++)
+		{
+			const double attenuation = brightness * (1.0 - 0.6 * y / height);
+			const bool reflector = std::abs(y - band) < 3;
+			const unsigned char* maskRow = m_pimpl->mask.data() + static_cast<size_t>(y) * width;
+			unsigned char* row = img->pointer() + static_cast<size_t>(y) * width * channels;
+			for (int x = 0; x < width; x++)
+			{
+				const unsigned char alpha = maskRow[x];
+				const unsigned char value = !alpha ? 0 : reflector ? 255 : static_cast<unsigned char>(std::min((xorshift(state) & 0xff) * attenuation, 255.0));
+				if (channels == 1)
+					row[x] = value;
+				else
+				{
+					row[x * 4 + 0] = value;
+					row[x * 4 + 1] = value;
+					row[x * 4 + 2] = value;
+					row[x * 4 + 3] = alpha;
+				}
+			}
+		}
+		img->setSpacing(pixelSize, pixelSize, 1., true);
+
+		if (m_settings.rawFrames && rawImageCallback)
+		{
+			ClariusRawFrame raw;
+			raw.lines = m_settings.rawSize[0];
+			raw.samples = m_settings.rawSize[1];
+			raw.bitsPerSample = 8;
+			raw.axialSize = depth * 1.e3 / raw.samples;
+			raw.lateralSize = (m_settings.convex ? convexRadius * sectorAngle : linearWidth) * 1.e3 / raw.lines;
+			raw.timestamp = timestamp;
+			ClariusFramePool::Key key;
+			key.width = raw.samples;
+			key.height = raw.lines;
+			key.channels = 1;
+			raw.data = framePool().acquire(key);
+			for (size_t i = 0; i < key.byteSize(); i++)
+				raw.data.data()[i] = static_cast<uint8_t>((xorshift(state) & 0xff) * brightness * (1.0 - 0.6 * (i % raw.samples) / raw.samples));
+			rawImageCallback(std::move(raw));
+		}
+
+		ClariusImageInfo info;
+		info.micronsPerPixel = pixelSize * 1.e3;
+		info.originX = 0.5 * width * info.micronsPerPixel;
+		sendFrame(std::move(img), info, timestamp, imuSamples);
+	}
+
+
+	void ClariusMockApi::runReplay()
+	{
+		const auto& frames = m_pimpl->replayFrames;
+		const auto& imu = m_pimpl->replayImu;
+		const unsigned long long first = frames.front().timestamp;
+		const unsigned long long duration = frames.back().timestamp - first;
+		const unsigned long long loopGap = frames.size() > 1 ? duration / (frames.size() - 1) : 33000000ull;
+
+		std::vector<ClariusImuSample> bundle;
+		auto start = Clock::now();
+		unsigned long long offset = 0;    // added to recorded timestamps, grows with every loop
+		size_t nextImu = 0;
+		while (true)
+		{
+			for (const ReplayFrame& frame : frames)
+			{
+				const unsigned long long elapsed = frame.timestamp - first;
+				if (m_settings.replayRealTime)
+				{
+					if (!m_pimpl->waitUntil(start + std::chrono::nanoseconds(elapsed)))
+						return;
+				}
+				else if (m_pimpl->stopExecution)
+					return;
+
+				// IMU samples up to the frame, bundled with it as the SDK does
+				bundle.clear();
+				for (; nextImu < imu.size() && imu[nextImu].timestamp <= frame.timestamp; nextImu++)
+				{
+					ClariusImuSample sample = imu[nextImu];
+					sample.timestamp = sample.timestamp + offset;
+					if (imuCallback)
+						imuCallback(sample);
+					bundle.push_back(sample);
+				}
+
+				const int width = frame.image.width();
+				const int height = frame.image.height();
+				const int channels = frame.image.format() == QImage::Format_Grayscale8 ? 1 : 4;
+				auto img = framePool().acquireImage<unsigned char>(width, height, channels);
+				for (int y = 0; y < height; y++)
+					memcpy(img->pointer() + static_cast<size_t>(y) * width * channels, frame.image.constScanLine(y), static_cast<size_t>(width) * channels);
+				img->setSpacing(frame.micronsPerPixel * 1.e-3, frame.micronsPerPixel * 1.e-3, 1., true);
+				if (measuresCallback)
+					measuresCallback(height * frame.micronsPerPixel * 1.e-3, width * frame.micronsPerPixel * 1.e-3);
+
+				// recordings do not store the origin, the probe face is assumed at the top center
+				ClariusImageInfo info;
+				info.micronsPerPixel = frame.micronsPerPixel;
+				info.originX = 0.5 * width * frame.micronsPerPixel;
+				sendFrame(std::move(img), info, frame.timestamp + offset, bundle);
+			}
+
+			if (!m_settings.replayLoop)
+				return;
+			offset += duration + loopGap;
+			start += std::chrono::nanoseconds(duration + loopGap);
+			nextImu = 0;
+		}
+	}
+
+
+	void ClariusMockApi::sendFrame(std::unique_ptr<TypedImage<unsigned char>> img,
+								   const ClariusImageInfo& info,
+								   unsigned long long timestamp,
+								   const std::vector<ClariusImuSample>& imuSamples)
+	{
+		std::unique_ptr<IMURawMetadata> imuMetadata;
+		if (!imuSamples.empty())
+		{
+			if (imageImuCallback)
+				imageImuCallback(imuSamples.data(), static_cast<int>(imuSamples.size()));
+			imuMetadata = std::make_unique<IMURawMetadata>();
+			imuMetadata->m_samples.resize(imuSamples.size());
+			for (size_t i = 0; i < imuSamples.size(); i++)
+			{
+				imuMetadata->m_samples[i].gyro = imuSamples[i].gyro;
+				imuMetadata->m_samples[i].linAcc = imuSamples[i].linAcc;
+				imuMetadata->m_samples[i].mag = imuSamples[i].mag;
+				imuMetadata->m_samples[i].timestamp = imuSamples[i].timestamp;
+			}
+		}
+
+		// the rendered ARGB frame plays the role of the SDK buffer
+		ClariusImageInfo frameInfo = info;
+		if (img->channels() == 4 && m_convertToGray)
+			img = m_grayIngest.convert(framePool(), img->pointer(), img->width(), img->height(), frameInfo);
+
+		m_pimpl->framesSent++;
+		if (imageInfoCallback)
+			imageInfoCallback(frameInfo);
+		if (imageCallback)
+			imageCallback(std::move(img), timestamp, std::move(imuMetadata));
+	}
+}
@@ -0,0 +1,98 @@
+/* Copyright (c) 2012-2019 ImFusion GmbH, Munich, Germany. All rights reserved. */
+#pragma once
+
+#include "ClariusApi.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ImFusion
+{
+	/**	\brief	ClariusApi backend that works without probe and network
+	 *
+	 *	Once connected, a background thread plays the role of the SDK thread and invokes the callbacks with either
+	 *	synthetic or replayed data. Synthetic frames show speckle inside a convex sector or linear field of view with a
+	 *	matching alpha mask, accompanied by IMU samples (standalone and bundled with the frames), optional raw line
+	 *	data as well as freeze and button events. Frame timing follows the configured rate with random jitter and
+	 *	periodic bursts of back-to-back frames.
+	 *
+	 *	A recorded session is a directory with a file frames.txt, holding one line "<timestamp in ns> <image file>
+	 *	[microns per pixel]" per frame, and an optional file imu.txt, holding one line "<timestamp in ns> gx gy gz ax
+	 *	ay az mx my mz qw qx qy qz" per IMU sample. All images are loaded on connect, so that replay at maximum speed
+	 *	is not limited by file access.
+	 *
+	 *	The synthetic field of view matches the probe reported by probeInfo(), with the probe face at the top center.
+	 *
+	 *	Only the uncompressed ARGB and 8-bit transport formats are supported. With setConvertToGray(), ARGB frames are
+	 *	rendered as usual and converted on ingest like the SDK buffer.
+	 */
+	class ClariusMockApi : public ClariusApi
+	{
+	public:
+		struct Settings
+		{
+			double fps = 30.0;                        ///< Frame rate of synthetic frames
+			vec2i resolution = vec2i(640, 480);      ///< Initial size of synthetic frames, changed by setResolution()
+			double depth = 100.0;                     ///< Initial imaging depth in mm, changed by setDepth()
+			bool convex = true;                       ///< Convex sector if true, linear field of view otherwise
+			double jitterMs = 1.0;                    ///< Maximum random deviation of the frame interval
+			int burstInterval = 0;                    ///< Number of frames between bursts, 0 disables bursts
+			int burstSize = 4;                        ///< Number of frames sent back-to-back in a burst
+			double imuRate = 100.0;                   ///< Rate of IMU samples in Hz, 0 disables IMU data
+			bool rawFrames = false;                   ///< If true, 8-bit envelope raw frames are sent along with every frame
+			vec2i rawSize = vec2i(192, 512);          ///< Number of lines and samples of raw frames
+			double freezeInterval = 0.0;              ///< Seconds between freezes, 0 disables freezing
+			double freezeDuration = 1.0;              ///< Duration of a freeze in seconds
+			double buttonInterval = 0.0;              ///< Seconds between button presses, 0 disables button events
+			std::string replayPath;                   ///< Directory of a recorded session, replaces synthetic data if set
+			bool replayRealTime = true;               ///< Replay with the recorded timing if true, as fast as possible otherwise
+			bool replayLoop = true;                   ///< Restart the replay at the end of the session
+			unsigned int seed = 1;                    ///< Seed of the random generator, for reproducible runs
+		};
+
+		ClariusMockApi();
+		explicit ClariusMockApi(const Settings& settings);
+		~ClariusMockApi() override;
+
+		bool init() override;
+		bool connect(const char* ipAddress, unsigned int port) override;
+		void disconnect() override;
+		void destroy() override;
+		bool loadCertificate(const std::string& path) override { return true; }
+
+		bool setGain(double gain) override;
+		bool setDepth(double depth) override;
+		bool setResolution(vec2i resolution) override;
+		bool setImageFormat(ImageFormat format, int numDecodeThreads = 2) override;
+		bool setSeparateOverlays(bool enable) override { return !enable; }
+		bool probeInfo(ClariusProbeInfo& info) override;
+
+		/// Settings the backend was created with
+		const Settings& settings() const { return m_settings; }
+
+		/// Number of frames sent since connecting
+		size_t numFramesSent() const;
+
+	private:
+		/// Generates synthetic frames, IMU samples and events until disconnected, runs on the SDK thread
+		void runSynthetic();
+
+		/// Replays the recorded session until disconnected, runs on the SDK thread
+		void runReplay();
+
+		/// Renders a synthetic frame and the raw data belonging to it
+		void sendSyntheticFrame(unsigned long long timestamp, int frameIndex, const std::vector<ClariusImuSample>& imuSamples);
+
+		/// Hands a frame with its imaging information and bundled IMU samples to the callbacks
+		void sendFrame(std::unique_ptr<TypedImage<unsigned char>> img,
+					   const ClariusImageInfo& info,
+					   unsigned long long timestamp,
+					   const std::vector<ClariusImuSample>& imuSamples);
+
+		struct Impl;
+		std::unique_ptr<Impl> m_pimpl;
+
+		const Settings m_settings;
+	};
+}
@@ -0,0 +1,202 @@
+/* Copyright (c) 2012-2019 ImFusion GmbH, Munich, Germany. All rights reserved. */
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ImFusion
+{
+	/// Statistics of a ClariusOrderedWorkerPool
+	struct ClariusWorkerPoolStats
+	{
+		size_t submitted = 0;      ///< Number of accepted inputs
+		size_t delivered = 0;      ///< Number of outputs passed to the deliver function
+		size_t dropped = 0;        ///< Number of inputs rejected because the pool was saturated
+		size_t pending = 0;        ///< Number of inputs currently queued or in flight
+		double lastTaskMs = 0.0;   ///< Processing time of the most recently finished input
+		double meanTaskMs = 0.0;   ///< Average processing time over all inputs
+		double maxTaskMs = 0.0;    ///< Maximum processing time over all inputs
+		double lastReorderWaitMs = 0.0;    ///< Time the most recently delivered output waited for earlier ones
+		double meanReorderWaitMs = 0.0;    ///< Average time an output waited for earlier ones before delivery
+		double maxReorderWaitMs = 0.0;     ///< Maximum time an output waited for earlier ones before delivery
+		std::vector<double> workerUtilization;    ///< Fraction of the time since the pool was started each worker spent processing
+	};
+
+
+	/**	\brief	Bounded pool of worker threads that processes inputs concurrently but delivers the results in submission order
+	 *
+	 *	Inputs are stored in a fixed ring of slots, so submitting does not allocate and never blocks: if all slots are
+	 *	occupied, submit() rejects the input. The deliver function is invoked for one output at a time, in the
+	 *	same order the inputs were submitted, from whichever worker completed the head of the queue. Outputs finished
+	 *	ahead of an earlier input wait in their slot, which is reported as reorder wait time.
+	 */
+	template <typename Input, typename Output>
+	class ClariusOrderedWorkerPool
+	{
+	public:
+		using ProcessFunction = std::function<Output(Input&&)>;
+		using DeliverFunction = std::function<void(Output&&)>;
+
+		/// Starts numWorkers threads, at most capacity inputs are in flight at any time
+		ClariusOrderedWorkerPool(int numWorkers, size_t capacity, ProcessFunction process, DeliverFunction deliver)
+			: m_process(std::move(process))
+			, m_deliver(std::move(deliver))
+			, m_slots(std::max<size_t>(capacity, 1))
+		{
+			m_busyMs.resize(std::max(numWorkers, 1), 0.0);
+			for (int i = 0; i < std::max(numWorkers, 1); i++)
+				m_workers.emplace_back([this, i]() { workerLoop(i); });
+		}
+
+		/// Stops all workers, pending inputs are discarded
+		~ClariusOrderedWorkerPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_stop = true;
+			}
+			m_conditionVariable.notify_all();
+			m_spaceAvailable.notify_all();
+			for (auto& t : m_workers)
+				t.join();
+		}
+
+		/// Queues an input for processing, returns false without taking the input if the pool is saturated
+		bool submit(Input&& input)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_nextSubmit - m_nextDeliver >= m_slots.size())
+				{
+					m_stats.dropped++;
+					return false;
+				}
+				Slot& slot = m_slots[m_nextSubmit % m_slots.size()];
+				slot.input = std::move(input);
+				slot.done = false;
+				m_nextSubmit++;
+				m_stats.submitted++;
+			}
+			m_conditionVariable.notify_one();
+			return true;
+		}
+
+		/// Waits until submit() would accept an input, returns false on timeout or if the pool is stopping
+		bool waitForSpace(std::chrono::milliseconds timeout)
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			return m_spaceAvailable.wait_for(lock, timeout, [this]() { return m_stop || m_nextSubmit - m_nextDeliver < m_slots.size(); }) && !m_stop;
+		}
+
+		int numWorkers() const { return static_cast<int>(m_workers.size()); }
+
+		ClariusWorkerPoolStats stats() const
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			ClariusWorkerPoolStats s = m_stats;
+			s.pending = static_cast<size_t>(m_nextSubmit - m_nextDeliver);
+			const double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_started).count();
+			for (double busy : m_busyMs)
+				s.workerUtilization.push_back(elapsedMs > 0.0 ? std::min(busy / elapsedMs, 1.0) : 0.0);
+			return s;
+		}
+
+	private:
+		struct Slot
+		{
+			Input input;
+			Output output;
+			bool done = false;
+			std::chrono::steady_clock::time_point finished;    ///< Time the output became ready
+		};
+
+		void workerLoop(int index)
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while (true)
+			{
+				m_conditionVariable.wait(lock, [this]() { return m_stop || m_nextProcess < m_nextSubmit; });
+				if (m_stop)
+					return;
+
+				const uint64_t seq = m_nextProcess++;
+				Slot& slot = m_slots[seq % m_slots.size()];
+				Input input = std::move(slot.input);
+				lock.unlock();
+
+				const auto start = std::chrono::steady_clock::now();
+				Output output = {};
+				try
+				{
+					output = m_process(std::move(input));
+				}
+				catch (...)
+				{
+				}
+				const auto finished = std::chrono::steady_clock::now();
+				const double ms = std::chrono::duration<double, std::milli>(finished - start).count();
+
+				lock.lock();
+				slot.output = std::move(output);
+				slot.done = true;
+				slot.finished = finished;
+				m_busyMs[index] += ms;
+				m_stats.lastTaskMs = ms;
+				m_stats.maxTaskMs = std::max(m_stats.maxTaskMs, ms);
+				m_numTasks++;
+				m_stats.meanTaskMs += (ms - m_stats.meanTaskMs) / m_numTasks;
+
+				// only one thread delivers at a time, which keeps the outputs in order
+				if (m_delivering)
+					continue;
+				m_delivering = true;
+				while (!m_stop && m_nextDeliver < m_nextProcess && m_slots[m_nextDeliver % m_slots.size()].done)
+				{
+					Slot& ready = m_slots[m_nextDeliver % m_slots.size()];
+					Output result = std::move(ready.output);
+					ready.done = false;
+					const double waitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - ready.finished).count();
+					m_stats.lastReorderWaitMs = waitMs;
+					m_stats.maxReorderWaitMs = std::max(m_stats.maxReorderWaitMs, waitMs);
+					m_stats.meanReorderWaitMs += (waitMs - m_stats.meanReorderWaitMs) / (m_stats.delivered + 1);
+					lock.unlock();
+					try
+					{
+						m_deliver(std::move(result));
+					}
+					catch (...)
+					{
+					}
+					lock.lock();
+					m_nextDeliver++;
+					m_stats.delivered++;
+					m_spaceAvailable.notify_one();
+				}
+				m_delivering = false;
+			}
+		}
+
+		ProcessFunction m_process;
+		DeliverFunction m_deliver;
+		std::vector<Slot> m_slots;    ///< Ring of inputs/outputs indexed by sequence number
+		std::vector<std::thread> m_workers;
+		mutable std::mutex m_mutex;    ///< Protects all members below
+		std::condition_variable m_conditionVariable;
+		std::condition_variable m_spaceAvailable;    ///< Notified whenever an output was delivered and its slot freed
+		const std::chrono::steady_clock::time_point m_started = std::chrono::steady_clock::now();
+		std::vector<double> m_busyMs;                ///< Accumulated processing time per worker
+		uint64_t m_nextSubmit = 0;
+		uint64_t m_nextProcess = 0;
+		uint64_t m_nextDeliver = 0;
+		uint64_t m_numTasks = 0;
+		bool m_delivering = false;
+		bool m_stop = false;
+		ClariusWorkerPoolStats m_stats;
+	};
+}
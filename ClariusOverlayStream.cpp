@@ -0,0 +1,187 @@
+#include "ClariusOverlayStream.h"
+
+#include "ClariusApi.h"
+#include "ClariusStream.h"
+
+#include <ImFusion/Base/TypedImage.h>
+#include <ImFusion/Core/Log.h>
+#include <ImFusion/GL/SharedImage.h>
+#include <ImFusion/Stream/ImageStreamData.h>
+
+#include <boost/lockfree/spsc_queue.hpp>
+
+#include <future>
+
+#undef IMFUSION_LOG_DEFAULT_CATEGORY
+#define IMFUSION_LOG_DEFAULT_CATEGORY "ClariusOverlayStream"
+
+
+namespace ImFusion
+{
+	struct ClariusOverlayStream::Impl
+	{
+		std::future<void> processingThread;           ///< Future wrapping the data processing thread.
+		std::condition_variable conditionVariable;    ///< Condition variable for notification of the processing thread
+		std::atomic<bool> stopExecution = {false};    ///< Flag whether to stop the execution of the processing thread.
+		std::mutex processingThreadMutex;             ///< Mutex protecting access to conditionVariable
+		boost::lockfree::spsc_queue<std::shared_ptr<const ClariusOverlayFrame>, boost::lockfree::capacity<16>> overlayBuffer;    ///< Overlays from the SDK thread
+		std::atomic<size_t> numDropped = {0};         ///< Number of overlays dropped because overlayBuffer was full
+		std::atomic<size_t> numEmpty = {0};           ///< Number of overlays without coloured pixels
+		ClariusFramePool croppedPool;                 ///< Buffers for the cropped overlays
+	};
+
+
+	ClariusOverlayStream::ClariusOverlayStream(ClariusStream* source, const std::string& name)
+		: ImageStream(name)
+		, m_pimpl(new Impl())
+	{
+		setModality(Data::ULTRASOUND);
+
+		IMFUSION_ASSERT(source);
+		source->overlayArrived.connect(this, [this](std::shared_ptr<const ClariusOverlayFrame> overlay) {
+			if (!m_isRunning)
+				return;
+			if (m_pimpl->overlayBuffer.push(std::move(overlay)))
+				m_pimpl->conditionVariable.notify_one();    // wake up processing thread
+			else
+				m_pimpl->numDropped++;
+		});
+
+		// Launch the processing thread
+		m_pimpl->processingThread = std::async(std::launch::async, [this]() {
+			try
+			{
+				std::unique_lock<std::mutex> lock(m_pimpl->processingThreadMutex);
+
+				while (!m_pimpl->stopExecution)
+				{
+					std::shared_ptr<const ClariusOverlayFrame> overlay;
+					while (m_pimpl->overlayBuffer.pop(overlay))
+					{
+						processOverlay(*overlay);
+						overlay.reset();
+					}
+
+					if (!m_pimpl->stopExecution)    // go hibernate
+						m_pimpl->conditionVariable.wait_for(lock, std::chrono::milliseconds(100));
+				}
+			}
+			catch (std::exception& e)
+			{
+				LOG_ERROR("An unexpected exception occurred while running the background thread. " << e.what());
+			}
+		});
+	}
+
+
+	ClariusOverlayStream::~ClariusOverlayStream()
+	{
+		m_isRunning = false;
+
+		// Let the background thread gracefully quit
+		{
+			std::unique_lock<std::mutex> lock(m_pimpl->processingThreadMutex);
+			m_pimpl->stopExecution = true;
+		}
+		while (m_pimpl->processingThread.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready)
+			m_pimpl->conditionVariable.notify_one();
+	}
+
+
+	bool ClariusOverlayStream::closeImpl()
+	{
+		m_isRunning = false;
+		return true;
+	}
+
+
+	bool ClariusOverlayStream::startImpl()
+	{
+		m_isRunning = true;
+		return true;
+	}
+
+
+	bool ClariusOverlayStream::stopImpl()
+	{
+		m_isRunning = false;
+		return true;
+	}
+
+
+	std::string ClariusOverlayStream::uuid()
+	{
+		std::stringstream ss;
+		ss << this;
+		return ss.str();
+	}
+
+
+	size_t ClariusOverlayStream::numDroppedFrames() const { return m_pimpl->numDropped; }
+
+
+	size_t ClariusOverlayStream::numEmptyFrames() const { return m_pimpl->numEmpty; }
+
+
+	void ClariusOverlayStream::processOverlay(const ClariusOverlayFrame& overlay)
+	{
+		if (!overlay.image)
+			return;
+		const TypedImage<unsigned char>& full = *overlay.image;
+		const int width = full.width();
+		const int height = full.height();
+		const int channels = full.channels();
+		const unsigned char* data = full.pointer();
+
+		// bounding box of the coloured pixels, i.e. non-zero alpha for ARGB and non-zero values otherwise
+		int x0 = width, y0 = height, x1 = -1, y1 = -1;
+		for (int y = 0; y < height; y++)
+		{
+			const unsigned char* row = data + static_cast<size_t>(y) * width * channels;
+			for (int x = 0; x < width; x++)
+			{
+				bool coloured = false;
+				if (channels == 4)
+					coloured = row[x * 4 + 3] != 0;
+				else
+					for (int c = 0; c < channels && !coloured; c++)
+						coloured = row[x * channels + c] != 0;
+				if (coloured)
+				{
+					x0 = std::min(x0, x);
+					x1 = std::max(x1, x);
+					y0 = std::min(y0, y);
+					y1 = y;
+				}
+			}
+		}
+		if (x1 < 0)
+		{
+			m_pimpl->numEmpty++;
+			return;
+		}
+
+		const int cropWidth = x1 - x0 + 1;
+		const int cropHeight = y1 - y0 + 1;
+		auto cropped = m_pimpl->croppedPool.acquireImage<unsigned char>(cropWidth, cropHeight, channels);
+		for (int y = 0; y < cropHeight; y++)
+			memcpy(cropped->pointer() + static_cast<size_t>(y) * cropWidth * channels,
+				   data + (static_cast<size_t>(y0 + y) * width + x0) * channels,
+				   static_cast<size_t>(cropWidth) * channels);
+		const vec3 spacing = full.spacing();
+		cropped->setSpacing(spacing, true);
+
+		// images are centered at the origin, so shift the crop by the offset of its center from the frame center
+		const vec3 offset((x0 + 0.5 * cropWidth - 0.5 * width) * spacing.x(), (y0 + 0.5 * cropHeight - 0.5 * height) * spacing.y(), 0.0);
+		mat4 matrix = mat4::Identity();
+		matrix.block<3, 1>(0, 3) = -offset;    // world to image
+
+		auto si = std::make_shared<SharedImage>(std::move(cropped));
+		si->setMatrix(matrix);
+
+		ImageStreamData isd(this, si);
+		isd.setTimestampArrival(std::chrono::system_clock::now());
+		isd.setTimestampDevice(static_cast<uint64_t>(overlay.timestamp / 1e6));    // ns to ms, pairs with the grayscale frame
+		signalNewData.emitSignal(isd);
+	}
+}
@@ -0,0 +1,62 @@
+/* Copyright (c) 2012-2019 ImFusion GmbH, Munich, Germany. All rights reserved. */
+#pragma once
+
+#include <ImFusion/Stream/ImageStream.h>
+
+#include <memory>
+
+namespace ImFusion
+{
+	class ClariusStream;
+	struct ClariusOverlayFrame;
+
+	/**	\brief	Image stream providing the colour Doppler and strain overlays of a ClariusStream
+	 *
+	 *	Requires ClariusStream::p_separateOverlays, so that the grayscale frames stay free of colour. Every overlay is
+	 *	cropped to the bounding box of its coloured pixels and positioned through its matrix, so that it lines up with
+	 *	the grayscale frame of the same device timestamp. Overlays without any coloured pixel are not emitted, hence
+	 *	consumers only pay for colour where there is some.
+	 */
+	class ClariusOverlayStream : public ImageStream
+	{
+	public:
+		/// Constructor, overlays are taken from the given source stream which manages the connection
+		explicit ClariusOverlayStream(ClariusStream* source, const std::string& name = "Clarius Overlay Stream");
+
+		~ClariusOverlayStream() override;
+
+		/// \name Stream Interface Methods
+		//\{
+
+		bool isRunning() const override { return m_isRunning; }
+
+		bool topDown() const override { return true; }
+
+		std::string uuid() override;
+
+		///\}
+
+		/// Number of overlays dropped because the stream could not keep up
+		size_t numDroppedFrames() const;
+
+		/// Number of overlays without coloured pixels, which have not been emitted
+		size_t numEmptyFrames() const;
+
+	protected:
+		bool openImpl() override { return true; }
+		bool closeImpl() override;
+		bool startImpl() override;
+		bool stopImpl() override;
+
+		std::optional<WorkContinuation> doWork() override { return std::nullopt; }
+
+	private:
+		/// Crops an overlay to its coloured region and emits it, called on the processing thread
+		void processOverlay(const ClariusOverlayFrame& overlay);
+
+		struct Impl;
+		std::unique_ptr<Impl> m_pimpl;
+
+		bool m_isRunning = false;    ///< True if stream is started
+	};
+}
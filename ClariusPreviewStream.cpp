@@ -0,0 +1,192 @@
+#include "ClariusPreviewStream.h"
+
+#include "ClariusFrameMetadata.h"
+#include "ClariusFramePool.h"
+#include "ClariusFrameQueue.h"
+#include "ClariusKernels.h"
+#include "ClariusStream.h"
+
+#include <ImFusion/Base/TypedImage.h>
+#include <ImFusion/Core/Log.h>
+#include <ImFusion/GL/SharedImage.h>
+#include <ImFusion/Stream/ImageStreamData.h>
+#include <ImFusion/US/FrameGeometry.h>
+
+#include <future>
+
+#undef IMFUSION_LOG_DEFAULT_CATEGORY
+#define IMFUSION_LOG_DEFAULT_CATEGORY "ClariusPreviewStream"
+
+
+namespace ImFusion
+{
+	struct ClariusPreviewStream::Impl
+	{
+		std::future<void> processingThread;           ///< Future wrapping the data processing thread.
+		std::condition_variable conditionVariable;    ///< Condition variable for notification of the processing thread
+		std::atomic<bool> stopExecution = {false};    ///< Flag whether to stop the execution of the processing thread.
+		std::mutex processingThreadMutex;             ///< Mutex protecting access to conditionVariable
+		ClariusFrameQueue<ClariusStreamFrame> frameQueue{1, ClariusDropPolicy::KeepLatest};    ///< Most recent frame of the source
+		std::atomic<size_t> numFrames = {0};          ///< Number of emitted previews
+		ClariusFramePool previewPool;                 ///< Buffers for the grayscale conversion and the previews
+
+		/// Metadata of the previews, only rebuilt when the source configuration or the dropped margin changes
+		std::shared_ptr<const ClariusFrameSnapshot> sourceSnapshot;
+		vec2 snapshotShift = vec2::Zero();
+		std::shared_ptr<const ClariusFrameSnapshot> snapshot;
+		uint64_t snapshotVersion = 0;
+	};
+
+
+	ClariusPreviewStream::ClariusPreviewStream(ClariusStream* source, const std::string& name)
+		: ImageStream(name)
+		, m_pimpl(new Impl())
+	{
+		setModality(Data::ULTRASOUND);
+
+		IMFUSION_ASSERT(source);
+		source->frameArrived.connect(this, [this](const ClariusStreamFrame& frame) {
+			if (!m_isRunning)
+				return;
+			// replaces a frame still waiting, so the source never waits for the preview
+			m_pimpl->frameQueue.push(std::make_unique<ClariusStreamFrame>(frame));
+			m_pimpl->conditionVariable.notify_one();    // wake up processing thread
+		});
+
+		// Launch the processing thread
+		m_pimpl->processingThread = std::async(std::launch::async, [this]() {
+			try
+			{
+				std::unique_lock<std::mutex> lock(m_pimpl->processingThreadMutex);
+
+				while (!m_pimpl->stopExecution)
+				{
+					while (auto frame = m_pimpl->frameQueue.pop())
+						processFrame(*frame);
+
+					if (!m_pimpl->stopExecution)    // go hibernate
+						m_pimpl->conditionVariable.wait_for(lock, std::chrono::milliseconds(100));
+				}
+			}
+			catch (std::exception& e)
+			{
+				LOG_ERROR("An unexpected exception occurred while running the background thread. " << e.what());
+			}
+		});
+	}
+
+
+	ClariusPreviewStream::~ClariusPreviewStream()
+	{
+		m_isRunning = false;
+
+		// Let the background thread gracefully quit
+		{
+			std::unique_lock<std::mutex> lock(m_pimpl->processingThreadMutex);
+			m_pimpl->stopExecution = true;
+		}
+		while (m_pimpl->processingThread.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready)
+			m_pimpl->conditionVariable.notify_one();
+	}
+
+
+	bool ClariusPreviewStream::closeImpl()
+	{
+		m_isRunning = false;
+		m_pimpl->frameQueue.clear();
+		return true;
+	}
+
+
+	bool ClariusPreviewStream::startImpl()
+	{
+		m_isRunning = true;
+		return true;
+	}
+
+
+	bool ClariusPreviewStream::stopImpl()
+	{
+		m_isRunning = false;
+		m_pimpl->frameQueue.clear();
+		return true;
+	}
+
+
+	std::string ClariusPreviewStream::uuid()
+	{
+		std::stringstream ss;
+		ss << this;
+		return ss.str();
+	}
+
+
+	size_t ClariusPreviewStream::numFrames() const { return m_pimpl->numFrames; }
+
+
+	size_t ClariusPreviewStream::numDroppedFrames() const { return m_pimpl->frameQueue.stats().superseded; }
+
+
+	void ClariusPreviewStream::processFrame(const ClariusStreamFrame& frame)
+	{
+		auto* img = frame.image ? dynamic_cast<const TypedImage<unsigned char>*>(frame.image->mem()) : nullptr;
+		if (!img || (img->channels() != 1 && img->channels() != 4))
+			return;
+		const int factor = std::max(p_factor.value(), 1);
+		const int width = img->width();
+		const int height = img->height();
+		if (width < factor || height < factor)
+			return;
+
+		// the source keeps colour if its grayscale conversion is disabled
+		std::unique_ptr<TypedImage<unsigned char>> gray;
+		if (img->channels() == 4)
+		{
+			gray = m_pimpl->previewPool.acquireImage<unsigned char>(width, height, 1);
+			ClariusKernels::argbToGray(img->pointer(), static_cast<size_t>(width) * height, gray->pointer(), nullptr);
+		}
+
+		std::unique_ptr<TypedImage<unsigned char>> preview;
+		if (factor == 1 && gray)
+			preview = std::move(gray);
+		else
+		{
+			preview = m_pimpl->previewPool.acquireImage<unsigned char>(width / factor, height / factor, 1);
+			ClariusKernels::boxDownsample(gray ? gray->pointer() : img->pointer(), width, height, factor, preview->pointer());
+			gray.reset();
+		}
+		const vec3 spacing = img->spacing();
+		preview->setSpacing(vec3(spacing.x() * factor, spacing.y() * factor, spacing.z()), true);
+
+		// rows and columns not filling a whole block are dropped, which moves the image center
+		const vec2 shift(0.5 * (preview->width() * factor - width) * spacing.x(), 0.5 * (preview->height() * factor - height) * spacing.y());
+		mat4 matrix = frame.image->matrix();
+		matrix.block<2, 1>(0, 3) -= shift;
+
+		if (frame.snapshot && (frame.snapshot != m_pimpl->sourceSnapshot || shift != m_pimpl->snapshotShift))
+		{
+			auto snapshot = std::make_shared<ClariusFrameSnapshot>(*frame.snapshot);
+			snapshot->version = ++m_pimpl->snapshotVersion;
+			if (frame.snapshot->geometry && !shift.isZero())
+			{
+				auto shifted = frame.snapshot->geometry->clone();
+				shifted->setOffset(frame.snapshot->geometry->offset() - shift);
+				snapshot->geometry = std::move(shifted);
+			}
+			m_pimpl->sourceSnapshot = frame.snapshot;
+			m_pimpl->snapshotShift = shift;
+			m_pimpl->snapshot = std::move(snapshot);
+		}
+
+		auto si = std::make_shared<SharedImage>(std::move(preview));
+		si->setMatrix(matrix);
+
+		ImageStreamData isd(this, si);
+		isd.setTimestampArrival(std::chrono::system_clock::now());
+		isd.setTimestampDevice(static_cast<uint64_t>(frame.timestamp / 1e6));    // ns to ms, pairs with the full resolution frame
+		if (frame.snapshot)
+			isd.components().add(std::make_unique<ClariusFrameMetadata>(m_pimpl->snapshot));
+		m_pimpl->numFrames++;
+		signalNewData.emitSignal(isd);
+	}
+}
@@ -0,0 +1,66 @@
+/* Copyright (c) 2012-2019 ImFusion GmbH, Munich, Germany. All rights reserved. */
+#pragma once
+
+#include <ImFusion/Core/Parameter.h>
+#include <ImFusion/Stream/ImageStream.h>
+
+#include <memory>
+
+namespace ImFusion
+{
+	class ClariusStream;
+	struct ClariusStreamFrame;
+
+	/**	\brief	Image stream providing a downsampled grayscale preview of the frames of a ClariusStream
+	 *
+	 *	Every frame is reduced by averaging blocks of p_factor x p_factor pixels, with spacing, pose and frame geometry
+	 *	adjusted so that the preview lines up with the full resolution frame of the same device timestamp. Frames are
+	 *	taken over from the source before they enter its processing queue and are reduced on a thread of their own,
+	 *	which only ever holds the most recent frame. Hence slow preview consumers drop preview frames instead of
+	 *	delaying the full resolution stream, and a backlog of the full resolution stream does not delay the preview.
+	 */
+	class ClariusPreviewStream : public ImageStream
+	{
+	public:
+		/// Constructor, frames are taken from the given source stream which manages the connection
+		explicit ClariusPreviewStream(ClariusStream* source, const std::string& name = "Clarius Preview Stream");
+
+		~ClariusPreviewStream() override;
+
+		/// \name Stream Interface Methods
+		//\{
+
+		bool isRunning() const override { return m_isRunning; }
+
+		bool topDown() const override { return true; }
+
+		std::string uuid() override;
+
+		///\}
+
+		/// Number of emitted previews
+		size_t numFrames() const;
+
+		/// Number of frames replaced by a newer one before the preview could be computed
+		size_t numDroppedFrames() const;
+
+		Parameter<int> p_factor = { "factor", 4, *this };    ///< Downsampling factor in each direction, 1 only converts to grayscale
+
+	protected:
+		bool openImpl() override { return true; }
+		bool closeImpl() override;
+		bool startImpl() override;
+		bool stopImpl() override;
+
+		std::optional<WorkContinuation> doWork() override { return std::nullopt; }
+
+	private:
+		/// Reduces a frame and emits it, called on the processing thread
+		void processFrame(const ClariusStreamFrame& frame);
+
+		struct Impl;
+		std::unique_ptr<Impl> m_pimpl;
+
+		bool m_isRunning = false;    ///< True if stream is started
+	};
+}
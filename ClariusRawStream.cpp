@@ -0,0 +1,211 @@
+#include "ClariusRawStream.h"
+
+#include "ClariusApi.h"
+#include "ClariusStream.h"
+
+#include <ImFusion/Base/TypedImage.h>
+#include <ImFusion/Core/Log.h>
+#include <ImFusion/GL/SharedImage.h>
+#include <ImFusion/Stream/ImageStreamData.h>
+#include <ImFusion/US/UltrasoundMetadata.h>
+
+#include <boost/lockfree/spsc_queue.hpp>
+
+#include <QImage>
+
+#include <future>
+
+#undef IMFUSION_LOG_DEFAULT_CATEGORY
+#define IMFUSION_LOG_DEFAULT_CATEGORY "ClariusRawStream"
+
+
+namespace ImFusion
+{
+	namespace
+	{
+		/// TypedImage referencing the samples of a raw frame, which is kept alive as long as the image exists
+		template <typename T>
+		class RawFrameImage : public TypedImage<T>
+		{
+		public:
+			RawFrameImage(const ImageDescriptor& desc, std::shared_ptr<const ClariusRawFrame> frame)
+				: TypedImage<T>(desc, reinterpret_cast<T*>(frame->data.data()), false)
+				, m_frame(std::move(frame))
+			{
+			}
+
+		private:
+			std::shared_ptr<const ClariusRawFrame> m_frame;
+		};
+	}
+
+
+	struct ClariusRawStream::Impl
+	{
+		std::future<void> processingThread;           ///< Future wrapping the data processing thread.
+		std::condition_variable conditionVariable;    ///< Condition variable for notification of the processing thread
+		std::atomic<bool> stopExecution = {false};    ///< Flag whether to stop the execution of the processing thread.
+		std::mutex processingThreadMutex;             ///< Mutex protecting access to conditionVariable
+		boost::lockfree::spsc_queue<std::shared_ptr<const ClariusRawFrame>, boost::lockfree::capacity<16>> frameBuffer;    ///< Frames from the SDK thread
+		std::atomic<size_t> numDropped = {0};         ///< Number of frames dropped because frameBuffer was full
+		ClariusFramePool decodedPool;                 ///< Buffers for decoded JPEG and B-mode converted RF frames
+		ClariusRfProcessor rfProcessor;               ///< Converts RF frames to B-mode if requested
+	};
+
+
+	ClariusRawStream::ClariusRawStream(ClariusStream* source, const std::string& name)
+		: ImageStream(name)
+		, m_pimpl(new Impl())
+	{
+		setModality(Data::ULTRASOUND);
+
+		IMFUSION_ASSERT(source);
+		source->rawFrameArrived.connect(this, [this](std::shared_ptr<const ClariusRawFrame> frame) {
+			if (!m_isRunning)
+				return;
+			if (m_pimpl->frameBuffer.push(std::move(frame)))
+				m_pimpl->conditionVariable.notify_one();    // wake up processing thread
+			else
+				m_pimpl->numDropped++;
+		});
+
+		// Launch the processing thread
+		m_pimpl->processingThread = std::async(std::launch::async, [this]() {
+			try
+			{
+				std::unique_lock<std::mutex> lock(m_pimpl->processingThreadMutex);
+
+				while (!m_pimpl->stopExecution)
+				{
+					std::shared_ptr<const ClariusRawFrame> frame;
+					while (m_pimpl->frameBuffer.pop(frame))
+					{
+						processFrame(frame);
+						frame.reset();
+					}
+
+					if (!m_pimpl->stopExecution)    // go hibernate
+						m_pimpl->conditionVariable.wait_for(lock, std::chrono::milliseconds(100));
+				}
+			}
+			catch (std::exception& e)
+			{
+				LOG_ERROR("An unexpected exception occurred while running the background thread. " << e.what());
+			}
+		});
+	}
+
+
+	ClariusRawStream::~ClariusRawStream()
+	{
+		m_isRunning = false;
+
+		// Let the background thread gracefully quit
+		{
+			std::unique_lock<std::mutex> lock(m_pimpl->processingThreadMutex);
+			m_pimpl->stopExecution = true;
+		}
+		while (m_pimpl->processingThread.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready)
+			m_pimpl->conditionVariable.notify_one();
+	}
+
+
+	bool ClariusRawStream::closeImpl()
+	{
+		m_isRunning = false;
+		return true;
+	}
+
+
+	bool ClariusRawStream::startImpl()
+	{
+		m_isRunning = true;
+		return true;
+	}
+
+
+	bool ClariusRawStream::stopImpl()
+	{
+		m_isRunning = false;
+		return true;
+	}
+
+
+	std::string ClariusRawStream::uuid()
+	{
+		std::stringstream ss;
+		ss << this;
+		return ss.str();
+	}
+
+
+	size_t ClariusRawStream::numDroppedFrames() const { return m_pimpl->numDropped; }
+
+
+	ClariusRfProcessor::Stats ClariusRawStream::rfProcessingStats() const { return m_pimpl->rfProcessor.stats(); }
+
+
+	void ClariusRawStream::processFrame(const std::shared_ptr<const ClariusRawFrame>& source)
+	{
+		const ClariusRawFrame& frame = *source;
+		std::unique_ptr<MemImage> img;
+		if (frame.jpegSize > 0)
+		{
+			QImage decoded;
+			if (!decoded.loadFromData(frame.data.data(), frame.jpegSize, "JPG"))
+			{
+				LOG_WARN("Could not decode compressed raw frame");
+				return;
+			}
+			if (decoded.format() != QImage::Format_Grayscale8)
+				decoded = decoded.convertToFormat(QImage::Format_Grayscale8);
+
+			auto typed = m_pimpl->decodedPool.acquireImage<unsigned char>(decoded.width(), decoded.height(), 1);
+			for (int y = 0; y < decoded.height(); y++)
+				memcpy(typed->pointer() + static_cast<size_t>(y) * decoded.width(), decoded.constScanLine(y), decoded.width());
+			img = std::move(typed);
+		}
+		else
+		{
+			// reference the pooled buffer filled on the SDK thread without copying, the frame is kept alive by the image
+			const int bytesPerSample = frame.data.key().bytesPerChannel;
+			const vec3i dims(frame.samples, frame.lines, 1);
+			if (bytesPerSample == 2 && frame.rf && p_rfToBMode)
+			{
+				m_pimpl->rfProcessor.setDynamicRange(p_dynamicRange);
+				m_pimpl->rfProcessor.setGain(p_gain);
+				auto typed = m_pimpl->decodedPool.acquireImage<unsigned char>(frame.samples, frame.lines, 1);
+				m_pimpl->rfProcessor.process(reinterpret_cast<const int16_t*>(frame.data.data()), frame.lines, frame.samples, typed->pointer());
+				img = std::move(typed);
+			}
+			else if (bytesPerSample == 1)
+				img = std::make_unique<RawFrameImage<unsigned char>>(ImageDescriptor(PixelType::UByte, dims, 1), source);
+			else if (bytesPerSample == 2 && frame.rf)
+				img = std::make_unique<RawFrameImage<short>>(ImageDescriptor(PixelType::Short, dims, 1), source);
+			else if (bytesPerSample == 2)
+				img = std::make_unique<RawFrameImage<unsigned short>>(ImageDescriptor(PixelType::UShort, dims, 1), source);
+			else
+			{
+				LOG_WARN("Unsupported raw data format with " << frame.bitsPerSample << " bits per sample");
+				return;
+			}
+		}
+		img->setSpacing(frame.axialSize * 1.e-3, frame.lateralSize * 1.e-3, 1., true);
+
+		const std::string probeID = "Clarius";
+
+		ImageStreamData isd(this, std::make_shared<SharedImage>(std::move(img)));
+		isd.setTimestampArrival(std::chrono::system_clock::now());
+		isd.setTimestampDevice(static_cast<uint64_t>(frame.timestamp / 1e6));    // ns to ms
+
+		auto metaUS = std::make_unique<US::UltrasoundMetadata>();
+		metaUS->m_device = probeID;
+		metaUS->m_probe = probeID;
+		metaUS->m_endDepth = frame.samples * frame.axialSize * 1.e-3;
+		metaUS->m_focalDepth = metaUS->m_endDepth / 2;
+		metaUS->m_scanConverted = false;
+		isd.components().add(std::move(metaUS));
+
+		signalNewData.emitSignal(isd);
+	}
+}
@@ -0,0 +1,71 @@
+/* Copyright (c) 2012-2019 ImFusion GmbH, Munich, Germany. All rights reserved. */
+#pragma once
+
+#include "ClariusRfProcessor.h"
+
+#include <ImFusion/Core/Parameter.h>
+#include <ImFusion/Stream/ImageStream.h>
+
+#include <memory>
+
+namespace ImFusion
+{
+	class ClariusStream;
+	struct ClariusRawFrame;
+
+	/**	\brief	Image stream providing the pre-scan-converted frames of a ClariusStream
+	 *
+	 *	Frames are laid out as stored by the probe: each image row holds one ultrasound line, i.e. the image width
+	 *	corresponds to the samples (axial direction) and the image height to the lines (lateral direction).
+	 *	Envelope data is provided as 8-bit, RF data as signed 16-bit images, or as 8-bit B-mode if p_rfToBMode is set;
+	 *	JPEG compressed frames are decoded to 8-bit. The SDK callback only copies the data into a pooled buffer, all
+	 *	further work is done on the stream's own thread. Uncompressed frames reference the buffer of the source frame,
+	 *	which is shared with other receivers and must not be modified.
+	 */
+	class ClariusRawStream : public ImageStream
+	{
+	public:
+		/// Constructor, frames are taken from the given source stream which manages the connection
+		explicit ClariusRawStream(ClariusStream* source, const std::string& name = "Clarius Raw Stream");
+
+		~ClariusRawStream() override;
+
+		/// \name Stream Interface Methods
+		//\{
+
+		bool isRunning() const override { return m_isRunning; }
+
+		bool topDown() const override { return true; }
+
+		std::string uuid() override;
+
+		///\}
+
+		/// Number of raw frames dropped because the stream could not keep up
+		size_t numDroppedFrames() const;
+
+		/// Per-frame timings of the RF to B-mode conversion
+		ClariusRfProcessor::Stats rfProcessingStats() const;
+
+		Parameter<bool> p_rfToBMode = { "rfToBMode", false, *this };             ///< If set to true, RF frames are converted to log-compressed B-mode
+		Parameter<double> p_dynamicRange = { "dynamicRange", 60.0, *this };      ///< Dynamic range in dB of the B-mode conversion, at least 1 dB
+		Parameter<double> p_gain = { "gain", 0.0, *this };                       ///< Gain in dB of the B-mode conversion
+
+	protected:
+		bool openImpl() override { return true; }
+		bool closeImpl() override;
+		bool startImpl() override;
+		bool stopImpl() override;
+
+		std::optional<WorkContinuation> doWork() override { return std::nullopt; }
+
+	private:
+		/// Converts a raw frame into stream data and emits it, called on the processing thread
+		void processFrame(const std::shared_ptr<const ClariusRawFrame>& source);
+
+		struct Impl;
+		std::unique_ptr<Impl> m_pimpl;
+
+		bool m_isRunning = false;    ///< True if stream is started
+	};
+}
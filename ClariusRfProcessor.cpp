@@ -0,0 +1,139 @@
+#include "ClariusRfProcessor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define CLARIUS_RF_SSE2
+#	include <emmintrin.h>
+#endif
+
+namespace ImFusion
+{
+	namespace
+	{
+		/// Half length of the Hilbert transformer, the filter has 2 * hilbertHalfLength + 1 taps
+		const int hilbertHalfLength = 15;
+
+		/// Full scale of 16-bit RF data in dB, used as reference level of the log compression
+		const double fullScaleDb = 20.0 * std::log10(32768.0);
+
+		/// 10 * log10(2), converts log2 of the squared magnitude into dB
+		const float dbPerLog2Power = 3.01029996f;
+
+		/// Per-thread scratch memory, only grows
+		std::vector<float>& scratch(size_t size)
+		{
+			thread_local std::vector<float> buffer;
+			if (buffer.size() < size)
+				buffer.resize(size);
+			return buffer;
+		}
+
+#ifdef CLARIUS_RF_SSE2
+		/// Approximation of log2 for positive finite values, absolute error below 1e-4
+		inline __m128 log2Approx(__m128 x)
+		{
+			const __m128i bits = _mm_castps_si128(x);
+			const __m128 exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+			const __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000)));
+			__m128 p = _mm_set1_ps(-0.056570851f);
+			p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(0.44717955f));
+			p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(-1.4699568f));
+			p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(2.8212026f));
+			p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(-1.7417939f));
+			return _mm_add_ps(p, exponent);
+		}
+#endif
+	}
+
+
+	ClariusRfProcessor::ClariusRfProcessor()
+	{
+		// Hamming windowed ideal Hilbert transformer, only odd taps are non-zero and h[-n] = -h[n]
+		const double pi = 3.14159265358979323846;
+		for (int n = 1; n <= hilbertHalfLength; n += 2)
+		{
+			double window = 0.54 + 0.46 * std::cos(pi * n / (hilbertHalfLength + 1));
+			m_taps.push_back(static_cast<float>(2.0 / (pi * n) * window));
+		}
+	}
+
+
+	void ClariusRfProcessor::process(const int16_t* rf, int lines, int samples, uint8_t* bmode)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		const double low = fullScaleDb - m_gain - m_dynamicRange;
+		const float scale = static_cast<float>(dbPerLog2Power * 255.0 / m_dynamicRange);
+		const float offset = static_cast<float>(-low * 255.0 / m_dynamicRange);
+		for (int l = 0; l < lines; l++)
+			processLine(rf + static_cast<size_t>(l) * samples, samples, bmode + static_cast<size_t>(l) * samples, scale, offset);
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		m_stats.frames++;
+		m_stats.lastMs = ms;
+		m_stats.maxMs = std::max(m_stats.maxMs, ms);
+		m_stats.meanMs += (ms - m_stats.meanMs) / m_stats.frames;
+	}
+
+
+	ClariusRfProcessor::Stats ClariusRfProcessor::stats() const
+	{
+		std::lock_guard<std::mutex> lock(m_statsMutex);
+		return m_stats;
+	}
+
+
+	void ClariusRfProcessor::processLine(const int16_t* rf, int samples, uint8_t* bmode, float scale, float offset) const
+	{
+		// zero padded copy of the line, so that the filter needs no boundary handling
+		const int pad = hilbertHalfLength;
+		std::vector<float>& buffer = scratch(static_cast<size_t>(samples) + 2 * pad);
+		float* x = buffer.data() + pad;
+		std::fill(buffer.begin(), buffer.begin() + pad, 0.f);
+		std::fill(buffer.begin() + pad + samples, buffer.begin() + 2 * pad + samples, 0.f);
+		for (int i = 0; i < samples; i++)
+			x[i] = rf[i];
+
+		const int numTaps = static_cast<int>(m_taps.size());
+		const float* taps = m_taps.data();
+		int i = 0;
+#ifdef CLARIUS_RF_SSE2
+		const __m128 vScale = _mm_set1_ps(scale);
+		const __m128 vOffset = _mm_set1_ps(offset);
+		const __m128 vEpsilon = _mm_set1_ps(1.f);
+		for (; i + 4 <= samples; i += 4)
+		{
+			__m128 q = _mm_setzero_ps();
+			for (int t = 0; t < numTaps; t++)
+			{
+				const int n = 2 * t + 1;
+				__m128 diff = _mm_sub_ps(_mm_loadu_ps(x + i - n), _mm_loadu_ps(x + i + n));
+				q = _mm_add_ps(q, _mm_mul_ps(_mm_set1_ps(taps[t]), diff));
+			}
+			const __m128 v = _mm_loadu_ps(x + i);
+			const __m128 power = _mm_add_ps(_mm_add_ps(_mm_mul_ps(v, v), _mm_mul_ps(q, q)), vEpsilon);
+			const __m128 value = _mm_add_ps(_mm_mul_ps(log2Approx(power), vScale), vOffset);
+			const __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(value), _mm_setzero_si128());
+			const int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(packed, packed));    // saturates to [0, 255]
+			std::memcpy(bmode + i, &bytes, 4);
+		}
+#endif
+		for (; i < samples; i++)
+		{
+			float q = 0.f;
+			for (int t = 0; t < numTaps; t++)
+			{
+				const int n = 2 * t + 1;
+				q += taps[t] * (x[i - n] - x[i + n]);
+			}
+			const float power = x[i] * x[i] + q * q + 1.f;
+			const float value = std::log2(power) * scale + offset;
+			bmode[i] = static_cast<uint8_t>(std::min(std::max(value + 0.5f, 0.f), 255.f));
+		}
+	}
+}
@@ -0,0 +1,55 @@
+/* Copyright (c) 2012-2019 ImFusion GmbH, Munich, Germany. All rights reserved. */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace ImFusion
+{
+	/**	\brief	Converts Clarius RF line data into log-compressed 8-bit B-mode data
+	 *
+	 *	Each line is filtered with a windowed FIR Hilbert transformer to obtain the analytic signal, whose magnitude
+	 *	is log compressed and mapped to 8 bits using the configured dynamic range and gain. The kernels process
+	 *	several samples per instruction (SSE2 on x86, scalar elsewhere) and work on a per-thread scratch arena,
+	 *	so no memory is allocated per frame once the largest frame size has been seen.
+	 */
+	class ClariusRfProcessor
+	{
+	public:
+		/// Timings of the processed frames
+		struct Stats
+		{
+			size_t frames = 0;      ///< Number of processed frames
+			double lastMs = 0.0;    ///< Processing time of the most recent frame
+			double meanMs = 0.0;    ///< Average processing time per frame
+			double maxMs = 0.0;     ///< Maximum processing time per frame
+		};
+
+		ClariusRfProcessor();
+
+		/// Dynamic range in dB mapped onto the 8-bit output range, values below 1 dB (and NaN) are clamped to 1 dB
+		void setDynamicRange(double dB) { m_dynamicRange = dB >= 1.0 ? dB : 1.0; }
+		double dynamicRange() const { return m_dynamicRange; }
+
+		/// Gain in dB added before mapping
+		void setGain(double dB) { m_gain = dB; }
+		double gain() const { return m_gain; }
+
+		/// Converts line-major signed 16-bit RF data (lines x samples) into B-mode data of the same layout
+		void process(const int16_t* rf, int lines, int samples, uint8_t* bmode);
+
+		Stats stats() const;
+
+	private:
+		void processLine(const int16_t* rf, int samples, uint8_t* bmode, float scale, float offset) const;
+
+		std::vector<float> m_taps;    ///< Non-zero (odd) Hilbert taps h[1], h[3], ...
+		double m_dynamicRange = 60.0;
+		double m_gain = 0.0;
+
+		mutable std::mutex m_statsMutex;    ///< Protects m_stats
+		Stats m_stats;
+	};
+}
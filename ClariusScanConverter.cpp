@@ -0,0 +1,235 @@
+#include "ClariusScanConverter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace ImFusion
+{
+	/// Persistent threads converting blocks of output rows, the calling thread takes part as well
+	struct ClariusScanConverter::Workers
+	{
+		explicit Workers(int numThreads)
+		{
+			for (int i = 1; i < numThreads; i++)
+				threads.emplace_back([this]() { loop(); });
+		}
+
+		~Workers()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stop = true;
+			}
+			startCondition.notify_all();
+			for (auto& t : threads)
+				t.join();
+		}
+
+		void run(const ClariusScanConverter* converter, const uint8_t* in, uint8_t* out, int rows)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				job = {converter, in, out, rows};
+				nextBlock = 0;
+				busy = static_cast<int>(threads.size());
+				generation++;
+			}
+			startCondition.notify_all();
+
+			work();
+
+			std::unique_lock<std::mutex> lock(mutex);
+			doneCondition.wait(lock, [this]() { return busy == 0; });
+		}
+
+		void loop()
+		{
+			uint64_t seen = 0;
+			while (true)
+			{
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					startCondition.wait(lock, [&]() { return stop || generation != seen; });
+					if (stop)
+						return;
+					seen = generation;
+				}
+				work();
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					busy--;
+				}
+				doneCondition.notify_one();
+			}
+		}
+
+		void work()
+		{
+			const int blockSize = 16;
+			while (true)
+			{
+				int first = nextBlock.fetch_add(blockSize);
+				if (first >= job.rows)
+					return;
+				job.converter->convertRows(job.in, job.out, first, std::min(first + blockSize, job.rows));
+			}
+		}
+
+		struct Job
+		{
+			const ClariusScanConverter* converter = nullptr;
+			const uint8_t* in = nullptr;
+			uint8_t* out = nullptr;
+			int rows = 0;
+		};
+
+		std::vector<std::thread> threads;
+		std::mutex mutex;    ///< Protects job, busy, generation and stop
+		std::condition_variable startCondition;
+		std::condition_variable doneCondition;
+		Job job;
+		std::atomic<int> nextBlock = {0};
+		int busy = 0;
+		uint64_t generation = 0;
+		bool stop = false;
+	};
+
+
+	bool ClariusScanConverter::ScanGeometry::operator==(const ScanGeometry& other) const
+	{
+		return lines == other.lines && samples == other.samples && axialSize == other.axialSize && lateralSize == other.lateralSize &&
+			   radius == other.radius;
+	}
+
+
+	ClariusScanConverter::ClariusScanConverter(int numThreads)
+		: m_workers(new Workers(std::max(numThreads, 1)))
+	{
+	}
+
+
+	ClariusScanConverter::~ClariusScanConverter() = default;
+
+
+	bool ClariusScanConverter::configure(const ScanGeometry& geometry, vec2i outputSize)
+	{
+		if (geometry == m_geometry && outputSize == m_outputSize && !m_lut.empty())
+			return false;
+
+		m_geometry = geometry;
+		m_outputSize = outputSize;
+		buildLut();
+		return true;
+	}
+
+
+	void ClariusScanConverter::buildLut()
+	{
+		const ScanGeometry& g = m_geometry;
+		const int width = std::max(m_outputSize[0], 1);
+		const int height = std::max(m_outputSize[1], 1);
+		m_lut.assign(static_cast<size_t>(width) * height, Entry{-1, 0, 0});
+		m_mask.assign(m_lut.size(), 0);
+		m_lutVersion++;
+		if (g.lines < 2 || g.samples < 2 || g.axialSize <= 0.0 || g.lateralSize <= 0.0)
+			return;
+
+		const double axial = g.axialSize * 1.e-3;      // mm per sample
+		const double lateral = g.lateralSize * 1.e-3;  // mm per line
+		const double depth = (g.samples - 1) * axial;
+		const double centerLine = 0.5 * (g.lines - 1);
+		const bool convex = g.radius > 0.0;
+		const double radius = g.radius;
+		const double lineAngle = convex ? lateral / radius : 0.0;    // radians between two lines
+
+		// bounding box of the scanned region, y points away from the transducer
+		double xMin, xMax, yMin, yMax;
+		if (convex)
+		{
+			const double maxAngle = centerLine * lineAngle;
+			xMax = (radius + depth) * std::sin(maxAngle);
+			yMin = radius * std::cos(maxAngle) - radius;
+			yMax = depth;
+		}
+		else
+		{
+			xMax = centerLine * lateral;
+			yMin = 0.0;
+			yMax = depth;
+		}
+		xMin = -xMax;
+
+		// isotropic spacing fitting the region into the output, centered horizontally
+		m_pixelSpacing = std::max((xMax - xMin) / width, (yMax - yMin) / height);
+		m_origin = vec2(0.5 * (xMin + xMax) - 0.5 * (width - 1) * m_pixelSpacing, yMin + 0.5 * m_pixelSpacing);
+
+		for (int py = 0; py < height; py++)
+		{
+			const double y = m_origin[1] + py * m_pixelSpacing;
+			for (int px = 0; px < width; px++)
+			{
+				const double x = m_origin[0] + px * m_pixelSpacing;
+				double line, sample;
+				if (convex)
+				{
+					const double dy = y + radius;
+					line = std::atan2(x, dy) / lineAngle + centerLine;
+					sample = (std::sqrt(x * x + dy * dy) - radius) / axial;
+				}
+				else
+				{
+					line = x / lateral + centerLine;
+					sample = y / axial;
+				}
+				if (line < 0.0 || sample < 0.0 || line > g.lines - 1 || sample > g.samples - 1)
+					continue;
+
+				// clamp so that the second neighbour is always valid
+				const int l0 = std::min(static_cast<int>(line), g.lines - 2);
+				const int s0 = std::min(static_cast<int>(sample), g.samples - 2);
+				Entry& e = m_lut[static_cast<size_t>(py) * width + px];
+				e.offset = l0 * g.samples + s0;
+				e.wLine = static_cast<uint16_t>(std::lround((line - l0) * 256.0));
+				e.wSample = static_cast<uint16_t>(std::lround((sample - s0) * 256.0));
+				m_mask[static_cast<size_t>(py) * width + px] = 255;
+			}
+		}
+	}
+
+
+	void ClariusScanConverter::convert(const uint8_t* lineData, uint8_t* output) const
+	{
+		if (m_lut.empty())
+			return;
+		m_workers->run(this, lineData, output, m_outputSize[1]);
+	}
+
+
+	void ClariusScanConverter::convertRows(const uint8_t* lineData, uint8_t* output, int firstRow, int lastRow) const
+	{
+		const int width = m_outputSize[0];
+		const int samples = m_geometry.samples;
+		for (int py = firstRow; py < lastRow; py++)
+		{
+			const Entry* lut = m_lut.data() + static_cast<size_t>(py) * width;
+			uint8_t* out = output + static_cast<size_t>(py) * width;
+			for (int px = 0; px < width; px++)
+			{
+				const Entry& e = lut[px];
+				if (e.offset < 0)
+				{
+					out[px] = 0;
+					continue;
+				}
+				const uint8_t* p = lineData + e.offset;
+				const uint32_t top = p[0] * (256u - e.wSample) + p[1] * e.wSample;
+				const uint32_t bottom = p[samples] * (256u - e.wSample) + p[samples + 1] * e.wSample;
+				out[px] = static_cast<uint8_t>((top * (256u - e.wLine) + bottom * e.wLine + (1u << 15)) >> 16);
+			}
+		}
+	}
+}
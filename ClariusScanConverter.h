@@ -0,0 +1,84 @@
+/* Copyright (c) 2012-2019 ImFusion GmbH, Munich, Germany. All rights reserved. */
+#pragma once
+
+#include <ImFusion/Core/Mat.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace ImFusion
+{
+	/**	\brief	Multi-threaded scan conversion of pre-scan-converted Clarius line data
+	 *
+	 *	A lookup table maps every output pixel to the four neighbouring line samples and their bilinear weights.
+	 *	It is only rebuilt when the scan geometry or the output size changes, so converting a frame is a single
+	 *	gather pass which is distributed row-wise over a set of persistent worker threads.
+	 */
+	class ClariusScanConverter
+	{
+	public:
+		/// Geometry of the line data, values as reported by the Cast SDK
+		struct ScanGeometry
+		{
+			int lines = 0;               ///< Number of ultrasound lines
+			int samples = 0;             ///< Number of samples per line
+			double axialSize = 0.0;      ///< Axial microns per sample
+			double lateralSize = 0.0;    ///< Lateral microns per line, measured along the transducer surface
+			double radius = 0.0;         ///< Transducer radius in millimeters, 0 for linear arrays
+
+			bool operator==(const ScanGeometry& other) const;
+			bool operator!=(const ScanGeometry& other) const { return !(*this == other); }
+		};
+
+		/// Constructor, conversion uses numThreads threads including the calling one
+		explicit ClariusScanConverter(int numThreads = 4);
+
+		~ClariusScanConverter();
+
+		/// Updates geometry and output size, the lookup table is rebuilt only if one of them changed
+		/// Returns true if the lookup table was rebuilt.
+		bool configure(const ScanGeometry& geometry, vec2i outputSize);
+
+		/// Scan converts line-major 8-bit line data (lines x samples) into an image of outputSize()
+		void convert(const uint8_t* lineData, uint8_t* output) const;
+
+		/// Size of the output image in pixels
+		vec2i outputSize() const { return m_outputSize; }
+
+		/// Isotropic output pixel spacing in millimeters
+		double pixelSpacing() const { return m_pixelSpacing; }
+
+		/// Position of the center of the top-left output pixel in millimeters, relative to the center of the transducer surface
+		vec2 outputOrigin() const { return m_origin; }
+
+		/// Mask of the output pixels covered by the line data (255 inside, 0 outside), in output layout
+		const std::vector<uint8_t>& mask() const { return m_mask; }
+
+		/// Increased every time the lookup table is rebuilt
+		int lutVersion() const { return m_lutVersion; }
+
+	private:
+		/// Lookup table entry of one output pixel
+		struct Entry
+		{
+			int32_t offset;    ///< Offset of the top-left neighbour in the line data, -1 if outside
+			uint16_t wLine;    ///< Weight of the next line in 1/256
+			uint16_t wSample;  ///< Weight of the next sample in 1/256
+		};
+
+		void buildLut();
+		void convertRows(const uint8_t* lineData, uint8_t* output, int firstRow, int lastRow) const;
+
+		ScanGeometry m_geometry;
+		vec2i m_outputSize = vec2i(0, 0);
+		double m_pixelSpacing = 0.0;
+		vec2 m_origin = vec2(0.0, 0.0);
+		std::vector<Entry> m_lut;
+		std::vector<uint8_t> m_mask;
+		int m_lutVersion = 0;
+
+		struct Workers;
+		std::unique_ptr<Workers> m_workers;
+	};
+}
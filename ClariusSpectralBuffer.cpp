@@ -0,0 +1,142 @@
+#include "ClariusSpectralBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace ImFusion
+{
+	bool ClariusSpectralBuffer::Format::operator==(const Format& other) const
+	{
+		return samples == other.samples && bytesPerSample == other.bytesPerSample && period == other.period;
+	}
+
+
+	ClariusSpectralBuffer::ClariusSpectralBuffer(double historySeconds)
+		: m_historySeconds(historySeconds)
+	{
+	}
+
+
+	void ClariusSpectralBuffer::append(const uint8_t* lines, int numLines, const Format& format)
+	{
+		if (numLines <= 0 || format.samples <= 0 || format.bytesPerSample <= 0)
+			return;
+
+		std::shared_ptr<Storage> storage;
+		double historySeconds;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			storage = m_storage;
+			historySeconds = m_historySeconds;
+		}
+		if (!storage || storage->format != format)
+		{
+			// readers still holding a window keep the old storage alive
+			storage = std::make_shared<Storage>();
+			storage->format = format;
+			storage->capacity = std::max(format.period > 0.0 ? static_cast<int>(std::ceil(historySeconds / format.period)) : 0, numLines);
+			storage->data.resize(2 * static_cast<size_t>(storage->capacity) * format.samples * format.bytesPerSample);
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_storage = storage;
+		}
+
+		const size_t lineBytes = static_cast<size_t>(format.samples) * format.bytesPerSample;
+		const int capacity = storage->capacity;
+		uint64_t written = storage->written.load(std::memory_order_relaxed);
+
+		// only the last capacity lines of an oversized block can be kept
+		if (numLines > capacity)
+		{
+			lines += (numLines - capacity) * lineBytes;
+			written += numLines - capacity;
+			numLines = capacity;
+		}
+
+		// publish every line individually, so that readers know that at most one line is being overwritten
+		for (int i = 0; i < numLines; i++)
+		{
+			const size_t slot = static_cast<size_t>((written + i) % capacity);
+			const uint8_t* src = lines + i * lineBytes;
+			memcpy(storage->data.data() + slot * lineBytes, src, lineBytes);
+			memcpy(storage->data.data() + (slot + capacity) * lineBytes, src, lineBytes);
+			storage->written.store(written + i + 1, std::memory_order_release);
+		}
+	}
+
+
+	ClariusSpectralBuffer::Window ClariusSpectralBuffer::window(double seconds) const
+	{
+		std::shared_ptr<Storage> storage;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			storage = m_storage;
+		}
+		if (!storage || storage->format.period <= 0.0)
+			return lastLines(0);
+		return lastLines(static_cast<int>(std::floor(seconds / storage->format.period)));
+	}
+
+
+	ClariusSpectralBuffer::Window ClariusSpectralBuffer::lastLines(int numLines) const
+	{
+		Window w;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			w.storage = m_storage;
+		}
+		auto storage = std::static_pointer_cast<const Storage>(w.storage);
+		if (!storage || numLines <= 0)
+			return w;
+
+		const uint64_t written = storage->written.load(std::memory_order_acquire);
+		const int lines = static_cast<int>(std::min<uint64_t>({static_cast<uint64_t>(numLines), written, static_cast<uint64_t>(storage->capacity)}));
+		const size_t lineBytes = static_cast<size_t>(storage->format.samples) * storage->format.bytesPerSample;
+		w.firstLine = written - lines;
+		w.lines = lines;
+		w.format = storage->format;
+		w.data = storage->data.data() + static_cast<size_t>(w.firstLine % storage->capacity) * lineBytes;
+		return w;
+	}
+
+
+	bool ClariusSpectralBuffer::isValid(const Window& w) const
+	{
+		auto storage = std::static_pointer_cast<const Storage>(w.storage);
+		if (!storage)
+			return w.lines == 0;
+		// the line currently being written replaces line (written - capacity)
+		return storage->written.load(std::memory_order_acquire) < w.firstLine + storage->capacity;
+	}
+
+
+	int ClariusSpectralBuffer::capacity() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_storage ? m_storage->capacity : 0;
+	}
+
+
+	double ClariusSpectralBuffer::historySeconds() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_historySeconds;
+	}
+
+
+	void ClariusSpectralBuffer::setHistorySeconds(double seconds)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (seconds == m_historySeconds)
+			return;
+		m_historySeconds = seconds;
+		m_storage.reset();
+	}
+
+
+	void ClariusSpectralBuffer::clear()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_storage.reset();
+	}
+}
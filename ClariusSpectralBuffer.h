@@ -0,0 +1,84 @@
+/* Copyright (c) 2012-2019 ImFusion GmbH, Munich, Germany. All rights reserved. */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace ImFusion
+{
+	/**	\brief	Fixed-size circular time-by-depth history of spectral (M-mode / PW Doppler) lines
+	 *
+	 *	Every line is stored twice, at its ring position and one capacity further, so that any window of up to
+	 *	capacity() consecutive lines is contiguous in memory. Appending therefore never shifts or reallocates the
+	 *	history, and readers can access the most recent lines without copying. Storage is only reallocated if the
+	 *	line format changes. There must be a single writer; readers may run concurrently on other threads.
+	 */
+	class ClariusSpectralBuffer
+	{
+	public:
+		/// Line format of the history
+		struct Format
+		{
+			int samples = 0;           ///< Samples per line
+			int bytesPerSample = 1;    ///< Bytes per sample
+			double period = 0.0;       ///< Line acquisition period in seconds
+
+			bool operator==(const Format& other) const;
+			bool operator!=(const Format& other) const { return !(*this == other); }
+		};
+
+		/// Contiguous read-only view onto the most recent lines, keeps the underlying storage alive
+		struct Window
+		{
+			const uint8_t* data = nullptr;    ///< First byte of the oldest line in the window, lines are stored consecutively
+			int lines = 0;                    ///< Number of lines in the window
+			Format format;                    ///< Format of the lines
+			uint64_t firstLine = 0;           ///< Index of the oldest line since the last format change
+			std::shared_ptr<const void> storage;    ///< Keeps data valid even if the buffer is reallocated
+		};
+
+		/// Constructor, the history covers at least the given duration
+		explicit ClariusSpectralBuffer(double historySeconds = 10.0);
+
+		/// Appends lines of the given format, changing the format clears the history
+		void append(const uint8_t* lines, int numLines, const Format& format);
+
+		/// Returns the most recent lines covering at most the given duration
+		Window window(double seconds) const;
+
+		/// Returns the most recent numLines lines, or fewer if the history is shorter
+		Window lastLines(int numLines) const;
+
+		/// Returns true if none of the lines of the window has been overwritten since it was obtained
+		/// Call after reading the window data to detect concurrent overwrites by a fast writer.
+		bool isValid(const Window& w) const;
+
+		/// Number of lines the history can hold with the current format
+		int capacity() const;
+
+		/// Duration covered by the history
+		double historySeconds() const;
+
+		/// Changes the duration covered by the history, clears the history if it differs from the current one
+		void setHistorySeconds(double seconds);
+
+		/// Clears the history
+		void clear();
+
+	private:
+		struct Storage
+		{
+			std::vector<uint8_t> data;    ///< 2 x capacity lines
+			Format format;
+			int capacity = 0;
+			std::atomic<uint64_t> written = {0};    ///< Number of lines appended so far
+		};
+
+		double m_historySeconds;
+		mutable std::mutex m_mutex;    ///< Protects m_historySeconds and the m_storage pointer, not its contents
+		std::shared_ptr<Storage> m_storage;
+	};
+}
@@ -0,0 +1,180 @@
+#include "ClariusSpectralStream.h"
+
+#include "ClariusApi.h"
+#include "ClariusStream.h"
+
+#include <ImFusion/Base/TypedImage.h>
+#include <ImFusion/Core/Log.h>
+#include <ImFusion/GL/SharedImage.h>
+#include <ImFusion/Stream/ImageStreamData.h>
+
+#include <boost/lockfree/spsc_queue.hpp>
+
+#include <future>
+
+#undef IMFUSION_LOG_DEFAULT_CATEGORY
+#define IMFUSION_LOG_DEFAULT_CATEGORY "ClariusSpectralStream"
+
+
+namespace ImFusion
+{
+	namespace
+	{
+		/// TypedImage referencing the samples of a spectral block, which is kept alive as long as the image exists
+		template <typename T>
+		class SpectralBlockImage : public TypedImage<T>
+		{
+		public:
+			SpectralBlockImage(const ImageDescriptor& desc, std::shared_ptr<const ClariusSpectralBlock> block)
+				: TypedImage<T>(desc, reinterpret_cast<T*>(block->data.data()), false)
+				, m_block(std::move(block))
+			{
+			}
+
+		private:
+			std::shared_ptr<const ClariusSpectralBlock> m_block;
+		};
+	}
+
+
+	struct ClariusSpectralStream::Impl
+	{
+		std::future<void> processingThread;           ///< Future wrapping the data processing thread.
+		std::condition_variable conditionVariable;    ///< Condition variable for notification of the processing thread
+		std::atomic<bool> stopExecution = {false};    ///< Flag whether to stop the execution of the processing thread.
+		std::mutex processingThreadMutex;             ///< Mutex protecting access to conditionVariable
+		boost::lockfree::spsc_queue<std::shared_ptr<const ClariusSpectralBlock>, boost::lockfree::capacity<64>> blockBuffer;    ///< Blocks from the SDK thread
+		std::atomic<size_t> numDropped = {0};         ///< Number of blocks dropped because blockBuffer was full
+		ClariusSpectralBuffer history;                ///< Only written by the processing thread
+	};
+
+
+	ClariusSpectralStream::ClariusSpectralStream(ClariusStream* source, const std::string& name)
+		: ImageStream(name)
+		, m_pimpl(new Impl())
+	{
+		setModality(Data::ULTRASOUND);
+
+		IMFUSION_ASSERT(source);
+		source->spectralBlockArrived.connect(this, [this](std::shared_ptr<const ClariusSpectralBlock> block) {
+			if (!m_isRunning)
+				return;
+			if (m_pimpl->blockBuffer.push(std::move(block)))
+				m_pimpl->conditionVariable.notify_one();    // wake up processing thread
+			else
+				m_pimpl->numDropped++;
+		});
+
+		// Launch the processing thread
+		m_pimpl->processingThread = std::async(std::launch::async, [this]() {
+			try
+			{
+				std::unique_lock<std::mutex> lock(m_pimpl->processingThreadMutex);
+
+				while (!m_pimpl->stopExecution)
+				{
+					std::shared_ptr<const ClariusSpectralBlock> block;
+					while (m_pimpl->blockBuffer.pop(block))
+					{
+						processBlock(block);
+						block.reset();
+					}
+
+					if (!m_pimpl->stopExecution)    // go hibernate
+						m_pimpl->conditionVariable.wait_for(lock, std::chrono::milliseconds(100));
+				}
+			}
+			catch (std::exception& e)
+			{
+				LOG_ERROR("An unexpected exception occurred while running the background thread. " << e.what());
+			}
+		});
+	}
+
+
+	ClariusSpectralStream::~ClariusSpectralStream()
+	{
+		m_isRunning = false;
+
+		// Let the background thread gracefully quit
+		{
+			std::unique_lock<std::mutex> lock(m_pimpl->processingThreadMutex);
+			m_pimpl->stopExecution = true;
+		}
+		while (m_pimpl->processingThread.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready)
+			m_pimpl->conditionVariable.notify_one();
+	}
+
+
+	bool ClariusSpectralStream::closeImpl()
+	{
+		m_isRunning = false;
+		return true;
+	}
+
+
+	bool ClariusSpectralStream::startImpl()
+	{
+		if (m_isRunning)
+			return true;
+
+		m_pimpl->history.setHistorySeconds(p_historySeconds);
+		m_isRunning = true;
+		return true;
+	}
+
+
+	bool ClariusSpectralStream::stopImpl()
+	{
+		m_isRunning = false;
+		return true;
+	}
+
+
+	std::string ClariusSpectralStream::uuid()
+	{
+		std::stringstream ss;
+		ss << this;
+		return ss.str();
+	}
+
+
+	ClariusSpectralBuffer::Window ClariusSpectralStream::window(double seconds) const { return m_pimpl->history.window(seconds); }
+
+
+	const ClariusSpectralBuffer& ClariusSpectralStream::history() const { return m_pimpl->history; }
+
+
+	size_t ClariusSpectralStream::numDroppedBlocks() const { return m_pimpl->numDropped; }
+
+
+	void ClariusSpectralStream::processBlock(const std::shared_ptr<const ClariusSpectralBlock>& source)
+	{
+		const ClariusSpectralBlock& block = *source;
+		const int bytesPerSample = block.data.key().bytesPerChannel;
+		ClariusSpectralBuffer::Format format;
+		format.samples = block.samples;
+		format.bytesPerSample = bytesPerSample;
+		format.period = block.period;
+		m_pimpl->history.append(block.data.data(), block.lines, format);
+
+		// emit the block itself, referencing the pooled buffer without copying, the block is kept alive by the image
+		std::unique_ptr<MemImage> img;
+		const vec3i dims(block.samples, block.lines, 1);
+		if (bytesPerSample == 1)
+			img = std::make_unique<SpectralBlockImage<unsigned char>>(ImageDescriptor(PixelType::UByte, dims, 1), source);
+		else if (bytesPerSample == 2)
+			img = std::make_unique<SpectralBlockImage<unsigned short>>(ImageDescriptor(PixelType::UShort, dims, 1), source);
+		else
+		{
+			LOG_WARN("Unsupported spectral data format with " << block.bitsPerSample << " bits per sample");
+			return;
+		}
+		// columns are depth in mm (M-mode) or velocity in m/s (PW), rows are time in ms
+		img->setSpacing(block.pw ? block.velocityPerSample : block.micronsPerSample * 1.e-3, block.period * 1.e3, 1., true);
+
+		ImageStreamData isd(this, std::make_shared<SharedImage>(std::move(img)));
+		isd.setTimestampArrival(std::chrono::system_clock::now());
+		signalNewData.emitSignal(isd);
+	}
+}
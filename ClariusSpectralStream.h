@@ -0,0 +1,69 @@
+/* Copyright (c) 2012-2019 ImFusion GmbH, Munich, Germany. All rights reserved. */
+#pragma once
+
+#include "ClariusSpectralBuffer.h"
+
+#include <ImFusion/Core/Parameter.h>
+#include <ImFusion/Stream/ImageStream.h>
+
+#include <memory>
+
+namespace ImFusion
+{
+	class ClariusStream;
+	struct ClariusSpectralBlock;
+
+	/**	\brief	Image stream providing the spectral (M-mode / PW Doppler) blocks of a ClariusStream
+	 *
+	 *	Every block is emitted as an image with one row per line (time) and one column per sample (depth or velocity),
+	 *	and appended to a fixed-size history. The history can be read as a zero-copy window of the most recent lines
+	 *	via window(), e.g. to display a scrolling spectrum without reallocating or shifting data for every block.
+	 */
+	class ClariusSpectralStream : public ImageStream
+	{
+	public:
+		/// Constructor, blocks are taken from the given source stream which manages the connection
+		explicit ClariusSpectralStream(ClariusStream* source, const std::string& name = "Clarius Spectral Stream");
+
+		~ClariusSpectralStream() override;
+
+		/// \name Stream Interface Methods
+		//\{
+
+		bool isRunning() const override { return m_isRunning; }
+
+		bool topDown() const override { return true; }
+
+		std::string uuid() override;
+
+		///\}
+
+		/// Returns the most recent lines covering at most the given duration, see ClariusSpectralBuffer::isValid()
+		ClariusSpectralBuffer::Window window(double seconds) const;
+
+		/// History of all received lines
+		const ClariusSpectralBuffer& history() const;
+
+		/// Number of blocks dropped because the stream could not keep up
+		size_t numDroppedBlocks() const;
+
+		Parameter<double> p_historySeconds = { "historySeconds", 10.0, *this };    ///< Duration kept in the history, applied on start
+
+	protected:
+		bool openImpl() override { return true; }
+		bool closeImpl() override;
+		bool startImpl() override;
+		bool stopImpl() override;
+
+		std::optional<WorkContinuation> doWork() override { return std::nullopt; }
+
+	private:
+		/// Appends a block to the history and emits it, called on the processing thread
+		void processBlock(const std::shared_ptr<const ClariusSpectralBlock>& source);
+
+		struct Impl;
+		std::unique_ptr<Impl> m_pimpl;
+
+		bool m_isRunning = false;    ///< True if stream is started
+	};
+}
@@ -1,6 +1,18 @@
 #include "ClariusStream.h"
 
 #include "ClariusApi.h"
+#include "ClariusFrame.h"
+#include "ClariusFrameMetadata.h"
+#include "ClariusFrameQueue.h"
+#include "ClariusGeometry.h"
+#include "ClariusGeometryCache.h"
+#include "ClariusGeometryDetector.h"
+#include "ClariusImuFeed.h"
+#include "ClariusImuHistory.h"
+#include "ClariusKernels.h"
+#include "ClariusMockApi.h"
+#include "ClariusRfProcessor.h"
+#include "ClariusScanConverter.h"
 
 #include <ImFusion/Base/IMUPoseIntegration.h>
 #include <ImFusion/Base/ImageProcessing.h>
@@ -12,12 +24,13 @@
 #include <ImFusion/US/FrameGeometryConvex.h>
 #include <ImFusion/US/FrameGeometryLinear.h>
 #include <ImFusion/US/FrameGeometryMetadata.h>
-#include <ImFusion/US/GeometryDetection.h>
 #include <ImFusion/US/UltrasoundMetadata.h>
 
-#include <boost/lockfree/queue.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
 
+#include <algorithm>
 #include <future>
+#include <thread>
 
 #undef IMFUSION_LOG_DEFAULT_CATEGORY
 #define IMFUSION_LOG_DEFAULT_CATEGORY "ClariusStream"
@@ -27,12 +40,39 @@ namespace ImFusion
 {
 	namespace
 	{
-		unsigned int hash(const unsigned char* data, int size)
+		/// Signature of the imaging parameters of a frame, used in place of the mask hash if no alpha channel is transmitted
+		unsigned int imagingHash(const MemImage& img)
 		{
-			int h = 0;
-			for (int i = 0; i < size; i++)
-				h = h * 33 + ((data[i] == 255) * i) % 701;
-			return h;
+			size_t h = std::hash<int>()(img.width());
+			h = h * 33 + std::hash<int>()(img.height());
+			h = h * 33 + std::hash<double>()(img.spacing().x());
+			return static_cast<unsigned int>(h);
+		}
+
+		/// Signature of the imaging parameters reported with a frame, changes whenever the analytic geometry does
+		unsigned int imageInfoHash(const MemImage& img, const ClariusImageInfo& info)
+		{
+			size_t h = std::hash<int>()(img.width());
+			h = h * 33 + std::hash<int>()(img.height());
+			h = h * 33 + std::hash<double>()(info.micronsPerPixel);
+			h = h * 33 + std::hash<double>()(info.originX);
+			h = h * 33 + std::hash<double>()(info.originY);
+			return static_cast<unsigned int>(h);
+		}
+
+		/// Number of frames whose non-zero pixels are combined into a mask if there is no alpha channel
+		const int numGrayMaskFrames = 5;
+
+		/// Maximum deviation in mm between analytic and detected geometry before a mismatch is reported
+		const double geometryTolerance = 2.0;
+
+		/// Copies a rectangle of the image into a pooled image with the same spacing
+		std::unique_ptr<TypedImage<unsigned char>> cropImage(ClariusFramePool& pool, const TypedImage<unsigned char>& img, const ClariusGeometry::PixelRect& rect)
+		{
+			auto cropped = pool.acquireImage<unsigned char>(rect.size[0], rect.size[1], img.channels());
+			ClariusKernels::copyRect(img.pointer(), img.width(), img.channels(), rect.origin[0], rect.origin[1], rect.size[0], rect.size[1], cropped->pointer());
+			cropped->setSpacing(img.spacing(), true);
+			return cropped;
 		}
 	}
 
@@ -44,85 +84,118 @@ namespace ImFusion
 		std::condition_variable conditionVariable;    ///< Condition variable for notification of the processing thread
 		std::atomic<bool> stopExecution = {false};    ///< Flag whether to stop the execution of the processing thread.
 		std::mutex processingThreadMutex;             ///< Mutex protecting access to conditionVariable
-		boost::lockfree::queue<ImageStreamData*, boost::lockfree::capacity<50>> scanDataBuffer;    ///< Thread-safe queue for scan data messages
+		ClariusFrameQueue<ImageStreamData> frameQueue;    ///< Frames waiting for the processing thread
+		using StagePool = ClariusOrderedWorkerPool<std::unique_ptr<ImageStreamData>, std::unique_ptr<ImageStreamData>>;
+		std::shared_ptr<StagePool> stagePool;         ///< Runs processFrame() for several frames at once if p_processingThreads > 1, swapped atomically
+		std::mutex parkMutex;                         ///< Held by the processing thread while deciding to park and while parked
+		std::atomic<bool> processingParked = {false};    ///< True while the processing thread waits on conditionVariable
+		std::atomic<size_t> wakeupNotifications = {0};   ///< Number of notifications sent to the parked processing thread
+
+		std::mutex wakeupMutex;                       ///< Protects the wakeup statistics below
+		std::vector<float> wakeupLatencies = std::vector<float>(4096);    ///< Most recent wakeup latencies in microseconds
+		size_t numWakeups = 0;
+		size_t numParks = 0;
+		std::mutex imageMutex;                        ///< Serializes handleImage() between SDK and scan conversion threads
+		ClariusImageInfo imageInfo;                   ///< Imaging information of the next frame of imageCallback, protected by imageMutex
+		bool hasImageInfo = false;
+
+		std::future<void> scanConversionThread;                 ///< Future wrapping the host scan conversion thread
+		std::condition_variable scanConversionCondition;        ///< Notifies the scan conversion thread about new raw frames
+		std::mutex scanConversionMutex;                         ///< Mutex protecting access to scanConversionCondition
+		boost::lockfree::spsc_queue<std::shared_ptr<const ClariusRawFrame>, boost::lockfree::capacity<4>> rawFrames;    ///< Raw frames to scan convert
+		std::unique_ptr<ClariusScanConverter> scanConverter;    ///< Created on first use, only accessed by the scan conversion thread
+		ClariusScanConverter::ScanGeometry scanGeometry;        ///< Line geometry the probe radius was queried for
+		double probeRadius = 0.0;                               ///< Transducer radius in mm, 0 for linear arrays
+		std::unique_ptr<TypedImage<unsigned char>> scanConversionMask;    ///< Region covered by the scan converted image
+		ClariusRfProcessor rfProcessor;                         ///< Converts RF frames to B-mode prior to scan conversion
+
+		std::unique_ptr<ClariusImuFeed> imuFeed;                ///< Delivers standalone IMU samples to imuSamplesArrived
+		ClariusImuHistory imuHistory;                           ///< Recent orientations from all IMU samples, used for the frame pose
+
+		ClariusGeometryDetector geometryDetector;               ///< Detects the frame geometry off the image callback
+		std::atomic<size_t> framesWithoutGeometry = {0};        ///< Number of emitted frames that had no geometry attached
+		ClariusGeometryCache geometryCache;                     ///< Detected geometries of known configurations, loaded on open and saved on close
+		std::string geometryCachePath;                          ///< File the cache was loaded from, empty if the cache is disabled
+		ClariusGeometryCache::Key geometryCacheKey;             ///< Configuration of the current mask, empty probe identity if unknown
+
+		std::shared_ptr<const ClariusFrameSnapshot> frameSnapshot;    ///< Metadata shared by the frames of the current configuration
+
+		/// Bounding box of the field of view, see p_cropToSector, only recomputed when the geometry changes
+		struct SectorCrop
+		{
+			std::shared_ptr<const US::FrameGeometry> source;      ///< Geometry of the full frame the crop was computed for
+			vec2i imageSize = vec2i::Zero();                      ///< Size of the full frame the crop was computed for
+			ClariusGeometry::PixelRect rect;                      ///< Region copied from the full frame
+			vec2 shift = vec2::Zero();                            ///< Center of the region relative to the center of the full frame in mm
+			std::shared_ptr<const US::FrameGeometry> geometry;    ///< Geometry of the cropped frame, null if cropping does not remove any pixels
+		} sectorCrop;
 	};
 
 	ClariusStream::ClariusStream(const std::string& name, bool useCastApi)
+		: ClariusStream(useCastApi ? nullptr : std::make_unique<ClariusMockApi>(), name)
+	{
+	}
+
+	ClariusStream::ClariusStream(std::unique_ptr<ClariusApi> api, const std::string& name)
 		: ImageStream(name)
+		, m_ownedApi(std::move(api))
 		, m_pimpl(new Impl())
 	{
 		setModality(Data::ULTRASOUND);
 
-		m_api = ClariusCastApi::get();
+		m_api = m_ownedApi ? m_ownedApi.get() : ClariusCastApi::get();
 
 		IMFUSION_ASSERT(m_api);
 
 		m_api->imageCallback =
 			[this](std::unique_ptr<TypedImage<unsigned char>>&& img, unsigned long long timestamp, std::unique_ptr<IMURawMetadata>&& imu) {
-				auto mask = TypedImage<unsigned char>::create(vec3i(img->width(), img->height(), 1), 1);
-				mask->setSpacing(img->spacing(), true);
-				for (int i = 0; i < img->width() * img->height(); i++)
-					mask->pointer()[i] = img->pointer()[i * 4 + 3];
-
-				unsigned int maskHash = hash(mask->pointer(), img->width() * img->height());
-
-				if (m_previousWidth != img->width() || m_previousHeight != img->height() || maskHash != m_previousMaskHash)
-					m_geometry.reset();
-
-				m_previousWidth = img->width();
-				m_previousHeight = img->height();
-				m_previousMaskHash = maskHash;
-
-				if (m_geometry == nullptr)
-				{
-					// make sure we don't run it on every frame if it fails
-					if (m_lastGeometryDetectionHash != maskHash)
-					{
-						US::GeometryDetection det;
-						m_geometry = det.compute(mask.get());
-						m_lastGeometryDetectionHash = maskHash;
-					}
-				}
-
-				if (!m_isRunning)
-					return;
-
-				const std::string probeID = "Clarius";
+				if (p_hostScanConversion)
+					return;    // frames are scan converted from the raw data instead
+				std::lock_guard<std::mutex> lock(m_pimpl->imageMutex);
+				handleImage(std::move(img), timestamp, std::move(imu), nullptr, m_pimpl->hasImageInfo ? &m_pimpl->imageInfo : nullptr);
+				m_pimpl->hasImageInfo = false;
+			};
 
-				std::shared_ptr<SharedImage> si = std::make_shared<SharedImage>(std::move(img));
-				auto* isd = new ImageStreamData(this,
-												si);    // we're transferring ownership here - make sure to delete the image afterward!
-				isd->setTimestampArrival(std::chrono::system_clock::now());
-				isd->setTimestampDevice(static_cast<uint64_t>(timestamp / 1e6));    // ns to ms
+		m_api->imageInfoCallback = [this](const ClariusImageInfo& info) {
+			std::lock_guard<std::mutex> lock(m_pimpl->imageMutex);
+			m_pimpl->imageInfo = info;
+			m_pimpl->hasImageInfo = true;
+		};
 
-				auto metaUS = std::make_unique<US::UltrasoundMetadata>();
-				metaUS->m_device = probeID;
-				metaUS->m_probe = probeID;
-				metaUS->m_endDepth = si->mem()->extent().y();
-				metaUS->m_focalDepth = metaUS->m_endDepth / 2;
-				metaUS->m_scanConverted = true;
-				isd->components().add(std::move(metaUS));
+		m_api->measuresCallback = [this](double depth, double width) { m_measuredDepth = depth; };
 
-				if (m_geometry)
-				{
-					auto metaGeom = std::make_unique<US::FrameGeometryMetadata>();
-					metaGeom->setFrameGeometry(m_geometry->clone());
-					isd->components().add(std::move(metaGeom));
-				}
+		m_api->rawImageCallback = [this](ClariusRawFrame&& frame) {
+			// immutable from here on, scan conversion and the raw data streams read the same buffer concurrently
+			std::shared_ptr<const ClariusRawFrame> shared = std::make_shared<ClariusRawFrame>(std::move(frame));
+			const bool envelope = !shared->rf && shared->bitsPerSample == 8;
+			const bool rf = shared->rf && shared->bitsPerSample == 16;
+			if (p_hostScanConversion && shared->jpegSize == 0 && (envelope || rf))
+			{
+				if (m_pimpl->rawFrames.push(shared))
+					m_pimpl->scanConversionCondition.notify_one();
+			}
+			rawFrameArrived.emitSignal(std::move(shared));
+		};
 
-				if (imu)
-					isd->components().add(std::move(imu));
+		m_api->overlayCallback = [this](ClariusOverlayFrame&& overlay) {
+			if (m_isRunning)
+				overlayArrived.emitSignal(std::make_shared<ClariusOverlayFrame>(std::move(overlay)));
+		};
 
-				if (m_pimpl->scanDataBuffer.push(isd))
-					m_pimpl->conditionVariable.notify_one();    // wake up processing thread
-				else
-				{
-					LOG_WARN("ClariusStream::onImageArrived: buffer full! Clearing buffer...");
-					clearBuffer();
-				}
-			};
+		m_api->spectralImageCallback = [this](ClariusSpectralBlock&& block) {
+			spectralBlockArrived.emitSignal(std::make_shared<ClariusSpectralBlock>(std::move(block)));
+		};
 
-		m_api->measuresCallback = [this](double depth, double width) { m_measuredDepth = depth; };
+		m_pimpl->imuFeed = std::make_unique<ClariusImuFeed>(
+			[this](std::shared_ptr<const ClariusImuFeed::Batch> batch) {
+				m_pimpl->imuHistory.add(batch->data(), batch->size());
+				imuSamplesArrived.emitSignal(std::move(batch));
+			});
+		m_api->imuCallback = [this](const ClariusImuSample& sample) {
+			if (m_isRunning)
+				m_pimpl->imuFeed->push(sample);
+		};
+		m_api->imageImuCallback = [this](const ClariusImuSample* samples, int count) { m_pimpl->imuHistory.add(samples, count); };
 
 		m_api->buttonCallback = [this](int button, int clicks) { buttonPressed.emitSignal(button); };
 
@@ -141,26 +214,63 @@ namespace ImFusion
 
 				while (!m_pimpl->stopExecution)
 				{
-					while (!m_pimpl->scanDataBuffer.empty())
+					// the first frame after being idle measures how long it took to wake up
+					bool idle = true;
+					ClariusFrameQueue<ImageStreamData>::Clock::time_point enqueued;
+					while (!m_pimpl->stopExecution)
 					{
-						ImageStreamData* isd;
-						if (!m_pimpl->scanDataBuffer.pop(isd))    // it's possible that while waiting for the lock, the queue has been cleared
+						// while all workers are busy, frames stay in the queue so that its drop policy applies
+						auto stages = std::atomic_load(&m_pimpl->stagePool);
+						if (stages && !stages->waitForSpace(std::chrono::milliseconds(100)))
+							continue;
+						auto isd = m_pimpl->frameQueue.pop(&enqueued);
+						if (!isd)
 							break;
 
-						if (p_convertToGray)
+						if (idle)
 						{
-							auto imgs = isd->images2();
-							auto newmem = ImageProcessing::createGrayscale(*imgs[0]->mem(), 3);
-							isd->setImages({std::make_shared<SharedImage>(std::move(newmem))});
+							const auto latency = std::chrono::steady_clock::now() - enqueued;
+							std::lock_guard<std::mutex> wakeupLock(m_pimpl->wakeupMutex);
+							m_pimpl->wakeupLatencies[m_pimpl->numWakeups++ % m_pimpl->wakeupLatencies.size()] =
+								std::chrono::duration<float, std::micro>(latency).count();
+							idle = false;
 						}
 
-						signalNewData.emitSignal(*isd);
-						delete isd;
+						// frames are queued in device timestamp order, which the pool keeps when delivering
+						if (stages)
+							stages->submit(std::move(isd));
+						else
+						{
+							processFrame(*isd);
+							signalNewData.emitSignal(*isd);
+						}
+					}
+
+					if (p_spinWakeup)
+					{
+						// low latency: poll for new frames for a while before parking, so that a frame arriving soon does not wait for the scheduler
+						const auto spinEnd = std::chrono::steady_clock::now() + std::chrono::microseconds(std::max(p_spinBudget.value(), 0));
+						while (!m_pimpl->stopExecution && m_pimpl->frameQueue.empty() && std::chrono::steady_clock::now() < spinEnd)
+							std::this_thread::yield();
+						if (!m_pimpl->frameQueue.empty())
+							continue;
 					}
 
 					if (!m_pimpl->stopExecution)    // go hibernate
 					{
-						m_pimpl->conditionVariable.wait(lock);
+						lock.unlock();
+						{
+							std::unique_lock<std::mutex> parkLock(m_pimpl->parkMutex);
+							m_pimpl->processingParked = true;
+							if (m_pimpl->frameQueue.empty() && !m_pimpl->stopExecution)
+								m_pimpl->conditionVariable.wait_for(parkLock, std::chrono::milliseconds(100));
+							m_pimpl->processingParked = false;
+						}
+						{
+							std::lock_guard<std::mutex> wakeupLock(m_pimpl->wakeupMutex);
+							m_pimpl->numParks++;
+						}
+						lock.lock();
 					}
 				}
 			}
@@ -169,6 +279,35 @@ namespace ImFusion
 				LOG_ERROR("An unexpected exception occurred while running the background thread. " << e.what());
 			}
 		});
+
+		// Launch the host scan conversion thread
+		m_pimpl->scanConversionThread = std::async(std::launch::async, [this]() {
+			try
+			{
+				std::unique_lock<std::mutex> lock(m_pimpl->scanConversionMutex);
+
+				while (!m_pimpl->stopExecution)
+				{
+					// only the most recent frame is converted, older ones are outdated already
+					std::shared_ptr<const ClariusRawFrame> frame, newer;
+					while (m_pimpl->rawFrames.pop(newer))
+						frame = std::move(newer);
+
+					if (frame)
+					{
+						lock.unlock();
+						scanConvert(*frame);
+						lock.lock();
+					}
+					else if (!m_pimpl->stopExecution)
+						m_pimpl->scanConversionCondition.wait_for(lock, std::chrono::milliseconds(100));
+				}
+			}
+			catch (std::exception& e)
+			{
+				LOG_ERROR("An unexpected exception occurred while running the scan conversion thread. " << e.what());
+			}
+		});
 	}
 
 
@@ -190,8 +329,12 @@ namespace ImFusion
 		}
 		while (m_pimpl->processingThread.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready)
 			m_pimpl->conditionVariable.notify_one();
+		while (m_pimpl->scanConversionThread.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready)
+			m_pimpl->scanConversionCondition.notify_one();
+		m_pimpl->imuFeed.reset();
+		std::atomic_store(&m_pimpl->stagePool, std::shared_ptr<Impl::StagePool>());
 
-		clearBuffer();
+		m_pimpl->frameQueue.clear();
 	}
 
 
@@ -210,12 +353,30 @@ namespace ImFusion
 				return false;
 			}
 
+			auto format = static_cast<ClariusApi::ImageFormat>(p_transportFormat.value());
+			if (!m_api->setImageFormat(format, p_decodeThreads))
+			{
+				LOG_WARN("Could not set the requested transport format, falling back to ARGB");
+				format = ClariusApi::ImageFormat::Argb;
+			}
+			m_useAlphaMask = format == ClariusApi::ImageFormat::Argb;
+
+			if (!m_api->setSeparateOverlays(p_separateOverlays))
+				LOG_WARN("Could not " << (p_separateOverlays ? "enable" : "disable") << " separate overlays");
+
 			if (!m_api->connect(p_serverAddress.value().c_str(), p_serverPort.value()))
 			{
 				LOG_ERROR("Could not connect to Clarius device");
 				return false;
 			}
 
+			m_pimpl->geometryCachePath.clear();
+			if (p_geometryCache)
+			{
+				m_pimpl->geometryCachePath = p_geometryCachePath.value().empty() ? ClariusGeometryCache::defaultPath() : p_geometryCachePath.value();
+				m_pimpl->geometryCache.load(m_pimpl->geometryCachePath);    // a missing file just means an empty cache
+			}
+
 			m_isInitialized = true;
 			LOG_INFO("Clarius connection established to " << p_serverAddress.value() << ", awaiting incoming UDP data");
 		}
@@ -232,6 +393,9 @@ namespace ImFusion
 	{
 		m_api->disconnect();
 
+		if (!m_pimpl->geometryCachePath.empty())
+			m_pimpl->geometryCache.save(m_pimpl->geometryCachePath);
+
 		m_isInitialized = false;
 		m_isRunning = false;
 		return true;
@@ -250,6 +414,30 @@ namespace ImFusion
 			return true;
 
 		LOG_INFO("Clarius US image stream started");
+		m_pimpl->imuFeed->setBatching(p_imuBatchSize, p_imuBatchLatency);
+		m_api->setConvertToGray(p_convertToGray && p_grayIngest);
+		m_pimpl->frameQueue.configure(std::max(p_queueCapacity.value(), 1), static_cast<ClariusDropPolicy>(std::clamp(p_queuePolicy.value(), 0, 3)), p_queueBlockTimeout);
+
+		auto stages = std::atomic_load(&m_pimpl->stagePool);
+		const int numStageThreads = p_processingThreads;
+		if (numStageThreads > 1 && (!stages || stages->numWorkers() != numStageThreads))
+		{
+			// two slots per worker, so that a finished frame waiting for an earlier one does not stall its worker
+			stages = std::make_shared<Impl::StagePool>(
+				numStageThreads,
+				2 * numStageThreads,
+				[this](std::unique_ptr<ImageStreamData>&& isd) {
+					processFrame(*isd);
+					return std::move(isd);
+				},
+				[this](std::unique_ptr<ImageStreamData>&& isd) {
+					if (isd)    // null if processFrame() threw
+						signalNewData.emitSignal(*isd);
+				});
+			std::atomic_store(&m_pimpl->stagePool, stages);
+		}
+		else if (numStageThreads <= 1 && stages)
+			std::atomic_store(&m_pimpl->stagePool, std::shared_ptr<Impl::StagePool>());
 		m_isRunning = true;
 
 		return m_api->start();
@@ -268,6 +456,347 @@ namespace ImFusion
 		return true;
 	}
 
+	void ClariusStream::processFrame(ImageStreamData& isd)
+	{
+		if (p_convertToGray && isd.images2()[0]->mem()->channels() != 1)
+		{
+			auto imgs = isd.images2();
+			auto newmem = ImageProcessing::createGrayscale(*imgs[0]->mem(), 3);
+			isd.setImages({std::make_shared<SharedImage>(std::move(newmem))});
+		}
+	}
+
+
+	void ClariusStream::handleImage(std::unique_ptr<TypedImage<unsigned char>> img,
+									unsigned long long timestamp,
+									std::unique_ptr<IMURawMetadata> imu,
+									const TypedImage<unsigned char>* knownMask,
+									const ClariusImageInfo* info)
+	{
+		updateGeometry(*img, knownMask, info);
+
+		if (!m_isRunning)
+			return;
+
+		const std::string probeID = "Clarius";
+		const double endDepth = img->extent().y();
+
+		// bounding box of the field of view, which only changes with the geometry
+		const Impl::SectorCrop* sector = nullptr;
+		if ((p_cropToSector || p_frameViews) && m_geometry)
+		{
+			auto& crop = m_pimpl->sectorCrop;
+			const vec2i imageSize(img->width(), img->height());
+			const double pixelSize = img->spacing().x();
+			if (crop.source != m_geometry || crop.imageSize != imageSize)
+			{
+				crop.source = m_geometry;
+				crop.imageSize = imageSize;
+				crop.rect = ClariusGeometry::boundingBox(*m_geometry, imageSize, pixelSize);
+				crop.geometry.reset();
+				if (crop.rect.size[0] > 0 && crop.rect.size[0] * crop.rect.size[1] < imageSize[0] * imageSize[1])
+				{
+					crop.shift = (crop.rect.origin.cast<double>() + 0.5 * crop.rect.size.cast<double>() - 0.5 * imageSize.cast<double>()) * pixelSize;
+					auto shifted = m_geometry->clone();
+					shifted->setOffset(m_geometry->offset() - crop.shift);
+					crop.geometry = std::move(shifted);
+				}
+			}
+			if (crop.geometry)
+				sector = &crop;
+		}
+
+		const TypedImage<unsigned char>* fullImage = img.get();
+		std::shared_ptr<SharedImage> original = std::make_shared<SharedImage>(std::move(img));
+		if (p_imuPose)
+		{
+			// orientation of the probe at the exact acquisition time of the frame
+			quat orientation;
+			const auto maxExtrapolation = static_cast<unsigned long long>(std::max(p_imuPoseTolerance.value(), 0.0) * 1e6);    // ms to ns
+			if (m_pimpl->imuHistory.orientationAt(timestamp, orientation, maxExtrapolation))
+			{
+				mat4 pose = mat4::Identity();
+				pose.block<3, 3>(0, 0) = orientation.toRotationMatrix().transpose();    // world to image
+				original->setMatrix(pose);
+			}
+		}
+
+		// the black border around the field of view is cut off
+		std::shared_ptr<SharedImage> si = original;
+		std::shared_ptr<const US::FrameGeometry> geometry = m_geometry;
+		if (p_cropToSector && sector)
+		{
+			si = std::make_shared<SharedImage>(cropImage(m_api->framePool(), *fullImage, sector->rect));
+			// keep the pixels at their place in the world, the image center moved by the crop
+			mat4 matrix = original->matrix();
+			matrix.block<2, 1>(0, 3) -= sector->shift;
+			si->setMatrix(matrix);
+			geometry = sector->geometry;
+		}
+
+		auto isd = std::make_unique<ImageStreamData>(this, si);
+		isd->setTimestampArrival(std::chrono::system_clock::now());
+		isd->setTimestampDevice(static_cast<uint64_t>(timestamp / 1e6));    // ns to ms
+
+		// the metadata only changes with the imaging configuration, so all frames share one immutable snapshot
+		auto& snapshot = m_pimpl->frameSnapshot;
+		if (!snapshot || snapshot->geometry != geometry || snapshot->ultrasound->m_endDepth != endDepth)
+		{
+			auto metaUS = std::make_shared<US::UltrasoundMetadata>();
+			metaUS->m_device = probeID;
+			metaUS->m_probe = probeID;
+			metaUS->m_endDepth = endDepth;
+			metaUS->m_focalDepth = metaUS->m_endDepth / 2;
+			metaUS->m_scanConverted = true;
+
+			auto newSnapshot = std::make_shared<ClariusFrameSnapshot>();
+			newSnapshot->version = snapshot ? snapshot->version + 1 : 1;
+			newSnapshot->geometry = geometry;
+			newSnapshot->ultrasound = std::move(metaUS);
+			snapshot = std::move(newSnapshot);
+		}
+		isd->components().add(std::make_unique<ClariusFrameMetadata>(snapshot));
+
+		if (p_frameViews)
+		{
+			// the uncropped frame as received, derived views are only computed if a consumer asks for them
+			if (sector)
+				isd->components().add(std::make_unique<ClariusFrame>(original, sector->rect, sector->geometry, p_cropToSector ? si : nullptr));
+			else
+				isd->components().add(std::make_unique<ClariusFrame>(original, ClariusGeometry::PixelRect(), m_geometry));
+		}
+
+		if (p_perFrameMetadata)
+		{
+			isd->components().add(std::make_unique<US::UltrasoundMetadata>(*snapshot->ultrasound));
+			if (geometry)
+			{
+				auto metaGeom = std::make_unique<US::FrameGeometryMetadata>();
+				metaGeom->setFrameGeometry(geometry->clone());
+				isd->components().add(std::move(metaGeom));
+			}
+		}
+
+		if (!m_geometry)
+			m_pimpl->framesWithoutGeometry++;
+
+		if (imu)
+			isd->components().add(std::move(imu));
+
+		// secondary streams get the frame before the processing queue, so they neither wait for nor delay its consumers
+		frameArrived.emitSignal(ClariusStreamFrame{si, timestamp, snapshot});
+
+		// a full queue drops frames according to p_queuePolicy
+		if (m_pimpl->frameQueue.push(std::move(isd)) && m_pimpl->processingParked)
+		{
+			// only a parked processing thread needs to be woken up, a busy or spinning one picks up the frame by itself
+			// taking parkMutex ensures that the thread is already waiting if it decided to park
+			{
+				std::lock_guard<std::mutex> parkLock(m_pimpl->parkMutex);
+			}
+			m_pimpl->conditionVariable.notify_one();
+			m_pimpl->wakeupNotifications++;
+		}
+	}
+
+
+	void ClariusStream::updateGeometry(const TypedImage<unsigned char>& img, const TypedImage<unsigned char>* knownMask, const ClariusImageInfo* info)
+	{
+		if (p_analyticGeometry && info)
+		{
+			// exact geometry from the probe description, only recomputed if the imaging parameters change
+			const unsigned int hash = imageInfoHash(img, *info);
+			if (hash != m_analyticGeometryHash)
+			{
+				ClariusProbeInfo probe;
+				m_analyticGeometry.reset();
+				if (m_api->probeInfo(probe))
+					m_analyticGeometry = ClariusGeometry::fromProbe(probe, *info, vec2i(img.width(), img.height()));
+				m_analyticGeometryHash = hash;
+				m_geometryValidated = false;
+			}
+			if (m_analyticGeometry && (!p_validateGeometry || m_geometryValidated))
+			{
+				m_geometry = m_analyticGeometry;
+				return;
+			}
+		}
+		else
+		{
+			m_analyticGeometry.reset();
+			m_analyticGeometryHash = 0;
+		}
+
+		// image-based detection as fallback, or to validate the analytic geometry once per imaging configuration
+		detectGeometry(img, knownMask, info);
+
+		if (m_analyticGeometry)
+		{
+			if (m_detectedGeometry)
+			{
+				if (!ClariusGeometry::agrees(*m_analyticGeometry, *m_detectedGeometry, geometryTolerance))
+					LOG_WARN("The frame geometry derived from the probe information does not match the one detected in the image");
+				m_geometryValidated = true;
+			}
+			m_geometry = m_analyticGeometry;
+		}
+		else
+			m_geometry = m_detectedGeometry;
+	}
+
+
+	void ClariusStream::detectGeometry(const TypedImage<unsigned char>& img, const TypedImage<unsigned char>* knownMask, const ClariusImageInfo* info)
+	{
+		const int numPixels = img.width() * img.height();
+		std::unique_ptr<TypedImage<unsigned char>> mask;
+		unsigned int maskHash = 0;
+		const int channels = img.channels();
+		const bool alphaMask = channels == 4 && m_useAlphaMask && !knownMask;
+		const bool ingestMask = !knownMask && info && info->mask;
+		const TypedImage<unsigned char>* regionMask = ingestMask ? info->mask.get() : knownMask;
+		if (alphaMask)
+		{
+			// ARGB transport: the alpha channel marks the valid image region, the mask itself is only extracted for geometry detection
+			maskHash = ClariusKernels::alphaSignature(img.pointer(), numPixels);
+		}
+		else if (ingestMask)
+		{
+			// ARGB transport converted to gray on ingest, which kept the alpha channel and its signature
+			maskHash = info->maskSignature;
+		}
+		else
+		{
+			// 8-bit, compressed and host scan converted frames have no alpha channel, so changes are detected from the imaging parameters
+			maskHash = imagingHash(img);
+		}
+
+		if (m_previousWidth != img.width() || m_previousHeight != img.height() || maskHash != m_previousMaskHash)
+		{
+			m_detectedGeometry.reset();
+			m_accumulatedMaskFrames = 0;
+
+			// a configuration seen before, possibly in an earlier session, does not need to be detected again
+			ClariusGeometryCache::Key& key = m_pimpl->geometryCacheKey;
+			ClariusProbeInfo probe;
+			key.probe = !m_pimpl->geometryCachePath.empty() && m_api->probeInfo(probe)
+							? ClariusGeometryCache::probeIdentity(probe.version, probe.elements, probe.pitch, probe.radius, probe.firmware)
+							: "";
+			key.size = vec2i(img.width(), img.height());
+			key.micronsPerPixel = img.spacing().x() * 1.e3;
+			key.signature = maskHash;
+			if (!key.probe.empty())
+			{
+				m_detectedGeometry = m_pimpl->geometryCache.find(key);
+				if (m_detectedGeometry)
+					m_lastGeometryDetectionHash = maskHash;
+			}
+		}
+
+		m_previousWidth = img.width();
+		m_previousHeight = img.height();
+		m_previousMaskHash = maskHash;
+
+		if (m_detectedGeometry == nullptr && alphaMask && m_lastGeometryDetectionHash != maskHash)
+		{
+			mask = TypedImage<unsigned char>::create(vec3i(img.width(), img.height(), 1), 1);
+			mask->setSpacing(img.spacing(), true);
+			ClariusKernels::extractAlpha(img.pointer(), numPixels, mask->pointer());
+		}
+		else if (m_detectedGeometry == nullptr && !alphaMask && !regionMask && m_lastGeometryDetectionHash != maskHash)
+		{
+			// Single frames contain black speckle inside the sector, so the mask is accumulated over a few frames
+			if (m_accumulatedMaskFrames == 0)
+			{
+				m_accumulatedMask = TypedImage<unsigned char>::create(vec3i(img.width(), img.height(), 1), 1);
+				m_accumulatedMask->setSpacing(img.spacing(), true);
+				memset(m_accumulatedMask->pointer(), 0, numPixels);
+			}
+			ClariusKernels::accumulateNonZero(img.pointer(), numPixels, channels, m_accumulatedMask->pointer());
+			if (++m_accumulatedMaskFrames >= numGrayMaskFrames)
+				mask = std::move(m_accumulatedMask);
+		}
+		else if (m_detectedGeometry == nullptr && regionMask && m_lastGeometryDetectionHash != maskHash)
+		{
+			// the known mask may be replaced while the detection is running, so the detector gets a copy
+			mask = TypedImage<unsigned char>::create(vec3i(regionMask->width(), regionMask->height(), 1), 1);
+			mask->setSpacing(regionMask->spacing(), true);
+			memcpy(mask->pointer(), regionMask->pointer(), numPixels);
+		}
+
+		if (mask)
+		{
+			// detection runs in the background, make sure we don't request it on every frame if it fails
+			m_pimpl->geometryDetector.detect(std::move(mask), maskHash);
+			m_lastGeometryDetectionHash = maskHash;
+		}
+
+		if (m_detectedGeometry == nullptr && m_lastGeometryDetectionHash == maskHash)
+		{
+			// frames are passed on without geometry until the detection of the current mask has finished
+			auto result = m_pimpl->geometryDetector.result();
+			if (result && result->signature == maskHash)
+			{
+				m_detectedGeometry = result->geometry;
+				if (m_detectedGeometry && !m_pimpl->geometryCacheKey.probe.empty())
+					m_pimpl->geometryCache.insert(m_pimpl->geometryCacheKey, m_detectedGeometry);
+			}
+		}
+	}
+
+
+	void ClariusStream::scanConvert(const ClariusRawFrame& frame)
+	{
+		if (!m_pimpl->scanConverter)
+			m_pimpl->scanConverter = std::make_unique<ClariusScanConverter>(p_scanConversionThreads);
+		ClariusScanConverter& converter = *m_pimpl->scanConverter;
+
+		ClariusScanConverter::ScanGeometry geometry;
+		geometry.lines = frame.lines;
+		geometry.samples = frame.samples;
+		geometry.axialSize = frame.axialSize;
+		geometry.lateralSize = frame.lateralSize;
+		if (geometry != m_pimpl->scanGeometry)
+		{
+			// the probe might have changed as well, so query its radius again
+			ClariusProbeInfo info;
+			m_pimpl->probeRadius = m_api->probeInfo(info) ? info.radius : 0.0;
+			m_pimpl->scanGeometry = geometry;
+		}
+		geometry.radius = m_pimpl->probeRadius;
+
+		if (converter.configure(geometry, p_hostOutputSize))
+		{
+			const vec2i size = converter.outputSize();
+			m_pimpl->scanConversionMask = TypedImage<unsigned char>::create(vec3i(size[0], size[1], 1), 1);
+			m_pimpl->scanConversionMask->setSpacing(converter.pixelSpacing(), converter.pixelSpacing(), 1., true);
+			memcpy(m_pimpl->scanConversionMask->pointer(), converter.mask().data(), converter.mask().size());
+		}
+
+		const uint8_t* lineData = frame.data.data();
+		ClariusFramePool::Buffer bmode;
+		if (frame.rf)
+		{
+			ClariusFramePool::Key key;
+			key.width = frame.samples;
+			key.height = frame.lines;
+			key.channels = 1;
+			bmode = m_api->framePool().acquire(key);
+			m_pimpl->rfProcessor.setDynamicRange(p_rfDynamicRange);
+			m_pimpl->rfProcessor.setGain(p_rfGain);
+			m_pimpl->rfProcessor.process(reinterpret_cast<const int16_t*>(frame.data.data()), frame.lines, frame.samples, bmode.data());
+			lineData = bmode.data();
+		}
+
+		const vec2i size = converter.outputSize();
+		auto img = m_api->framePool().acquireImage<unsigned char>(size[0], size[1], 1);
+		converter.convert(lineData, img->pointer());
+		img->setSpacing(converter.pixelSpacing(), converter.pixelSpacing(), 1., true);
+
+		std::lock_guard<std::mutex> lock(m_pimpl->imageMutex);
+		handleImage(std::move(img), frame.timestamp, nullptr, m_pimpl->scanConversionMask.get(), nullptr);
+	}
+
+
 	void ClariusStream::onImageArrived(std::unique_ptr<MemImage> mem, unsigned long long imgTm, std::unique_ptr<IMURawMetadata> imuMetadata) {}
 
 
@@ -284,10 +813,46 @@ namespace ImFusion
 		ImageStream::configure(p);
 	}
 
-	void ClariusStream::clearBuffer()
+	ClariusFramePool::Stats ClariusStream::framePoolStats() const { return m_api->framePool().stats(); }
+
+	ClariusWorkerPoolStats ClariusStream::decodeStats() const { return m_api->decodeStats(); }
+
+	ClariusRfProcessor::Stats ClariusStream::rfProcessingStats() const { return m_pimpl->rfProcessor.stats(); }
+
+	size_t ClariusStream::numDroppedImuSamples() const { return m_pimpl->imuFeed->numDropped(); }
+
+	ClariusGeometryDetector::Stats ClariusStream::geometryDetectionStats() const { return m_pimpl->geometryDetector.stats(); }
+
+	size_t ClariusStream::numFramesWithoutGeometry() const { return m_pimpl->framesWithoutGeometry; }
+
+	ClariusGeometryCache::Stats ClariusStream::geometryCacheStats() const { return m_pimpl->geometryCache.stats(); }
+
+	ClariusFrameQueueStats ClariusStream::queueStats() const { return m_pimpl->frameQueue.stats(); }
+
+	ClariusWorkerPoolStats ClariusStream::processingStats() const
+	{
+		auto stages = std::atomic_load(&m_pimpl->stagePool);
+		return stages ? stages->stats() : ClariusWorkerPoolStats();
+	}
+
+	ClariusStream::WakeupStats ClariusStream::wakeupStats() const
 	{
-		ImageStreamData* tmp;
-		while (m_pimpl->scanDataBuffer.pop(tmp))
-			delete tmp;
+		WakeupStats stats;
+		std::vector<float> latencies;
+		{
+			std::lock_guard<std::mutex> lock(m_pimpl->wakeupMutex);
+			stats.wakeups = m_pimpl->numWakeups;
+			stats.parks = m_pimpl->numParks;
+			latencies.assign(m_pimpl->wakeupLatencies.begin(), m_pimpl->wakeupLatencies.begin() + std::min(m_pimpl->numWakeups, m_pimpl->wakeupLatencies.size()));
+		}
+		stats.notifications = m_pimpl->wakeupNotifications;
+		if (!latencies.empty())
+		{
+			std::sort(latencies.begin(), latencies.end());
+			stats.p50Us = latencies[latencies.size() / 2];
+			stats.p99Us = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+			stats.maxUs = latencies.back();
+		}
+		return stats;
 	}
 }
@@ -1,10 +1,18 @@
 /* Copyright (c) 2012-2019 ImFusion GmbH, Munich, Germany. All rights reserved. */
 #pragma once
 
+#include "ClariusFramePool.h"
+#include "ClariusFrameQueue.h"
+#include "ClariusGeometryCache.h"
+#include "ClariusGeometryDetector.h"
+#include "ClariusOrderedWorkerPool.h"
+#include "ClariusRfProcessor.h"
+
 #include <ImFusion/Core/Parameter.h>
 #include <ImFusion/Stream/ImageStream.h>
 
 #include <memory>
+#include <vector>
 
 namespace ImFusion
 {
@@ -12,12 +20,27 @@ namespace ImFusion
 
 	class IMURawMetadata;
 	class ClariusApi;
+	struct ClariusRawFrame;
+	struct ClariusSpectralBlock;
+	struct ClariusImuSample;
+	struct ClariusOverlayFrame;
+	struct ClariusImageInfo;
+	struct ClariusFrameSnapshot;
+	class SharedImage;
 
 	namespace US
 	{
 		class FrameGeometry;
 	}
 
+	/// Frame handed to secondary streams before it is queued for processing, see ClariusStream::frameArrived
+	struct ClariusStreamFrame
+	{
+		std::shared_ptr<SharedImage> image;                      ///< Frame with its pose, cropped if ClariusStream::p_cropToSector is set
+		unsigned long long timestamp = 0;                        ///< Device timestamp in nanoseconds
+		std::shared_ptr<const ClariusFrameSnapshot> snapshot;    ///< Imaging configuration the frame was acquired with
+	};
+
 	/**	\brief	Stream class for the Clarius ultrasound system
 	 *	\author	Oliver Zettinig
 	 */
@@ -27,9 +50,12 @@ namespace ImFusion
 		/// Currently, only one instance is allowed
 		static bool canInstantiate();
 
-		/// Constructor
+		/// Constructor, uses the Clarius Cast SDK or, if useCastApi is false, a ClariusMockApi with default settings
 		explicit ClariusStream(const std::string& name = "Clarius Stream", bool useCastApi = true);
 
+		/// Constructor using the given backend, e.g. a configured ClariusMockApi, or the Clarius Cast SDK if api is null
+		explicit ClariusStream(std::unique_ptr<ClariusApi> api, const std::string& name = "Clarius Stream");
+
 		/// Destructor
 		~ClariusStream() override;
 
@@ -54,13 +80,97 @@ namespace ImFusion
 
 		void configure(const Properties* p) override;
 
+		/// Statistics of the frame buffer pool used for incoming images
+		ClariusFramePool::Stats framePoolStats() const;
+
+		/// Per-frame decode timings for JPEG/PNG transport
+		ClariusWorkerPoolStats decodeStats() const;
+
+		/// Per-frame timings of the RF to B-mode conversion for host scan conversion
+		ClariusRfProcessor::Stats rfProcessingStats() const;
+
+		/// Number of standalone IMU samples dropped because the consumers could not keep up
+		size_t numDroppedImuSamples() const;
+
+		/// Timings of the frame geometry detection, which runs on a background thread
+		ClariusGeometryDetector::Stats geometryDetectionStats() const;
+
+		/// Number of frames emitted without geometry, e.g. while the detection after a depth change is running
+		size_t numFramesWithoutGeometry() const;
+
+		/// Depth, high-water mark and drop counters of the queue between image callback and processing thread
+		ClariusFrameQueueStats queueStats() const;
+
+		/// Wakeups of the processing thread, see p_spinWakeup
+		struct WakeupStats
+		{
+			size_t wakeups = 0;          ///< Number of frames that found the processing thread idle
+			size_t parks = 0;            ///< Number of times the processing thread waited for a notification
+			size_t notifications = 0;    ///< Number of notifications sent by the image callback
+			double p50Us = 0.0;          ///< Median time from queuing such a frame until it is picked up, over the recent wakeups
+			double p99Us = 0.0;          ///< 99th percentile of the wakeup latency
+			double maxUs = 0.0;          ///< Maximum wakeup latency
+		};
+		WakeupStats wakeupStats() const;
+
+		/// Per-worker utilization and reorder wait of the parallel processing stages, empty if p_processingThreads is 1
+		ClariusWorkerPoolStats processingStats() const;
+
+		/// Lookups in the cache of detected frame geometries, see p_geometryCache
+		ClariusGeometryCache::Stats geometryCacheStats() const;
+
 		Parameter<std::string> p_serverAddress = { "serverAddress", "", *this };    ///< Host name for listener connection
 		Parameter<unsigned int> p_serverPort = { "serverPort", 35583, *this };      ///< Port for listener connection
 		Parameter<bool> p_convertToGray = { "convertToGray", false, *this };        ///< If set to true, result images will be converted to greyscale
+		Parameter<bool> p_grayIngest = { "grayIngest", true, *this };              ///< If set to true together with convertToGray, frames are converted while being copied from the SDK, applied on start
 		Parameter<bool> p_flipView = { "flipView", false, *this };                  ///< If set to true the controller will flip the view
+		Parameter<int> p_transportFormat = { "transportFormat", 0, *this };         ///< Image format sent by the probe (0: 32-bit ARGB, 1: 8-bit grayscale, 2: JPEG, 3: PNG), applied on open
+		Parameter<int> p_decodeThreads = { "decodeThreads", 2, *this };             ///< Number of threads decoding JPEG/PNG frames, applied on open
+		Parameter<bool> p_hostScanConversion = { "hostScanConversion", false, *this };    ///< If set to true, images are scan converted on the host from the raw line data
+		Parameter<vec2i> p_hostOutputSize = { "hostOutputSize", vec2i(640, 480), *this }; ///< Output size of the host scan conversion
+		Parameter<int> p_scanConversionThreads = { "scanConversionThreads", 4, *this };   ///< Number of threads used for host scan conversion, applied on first use
+		Parameter<double> p_rfDynamicRange = { "rfDynamicRange", 60.0, *this };          ///< Dynamic range in dB when converting RF data to B-mode, at least 1 dB
+		Parameter<double> p_rfGain = { "rfGain", 0.0, *this };                           ///< Gain in dB when converting RF data to B-mode
+		Parameter<int> p_imuBatchSize = { "imuBatchSize", 1, *this };                     ///< Number of standalone IMU samples delivered together, applied on start
+		Parameter<int> p_imuBatchLatency = { "imuBatchLatency", 5, *this };               ///< Maximum delay in ms before an incomplete IMU batch is delivered, applied on start
+		Parameter<bool> p_separateOverlays = { "separateOverlays", false, *this };         ///< If set to true, colour Doppler and strain overlays are sent separately, see ClariusOverlayStream, applied on open
+		Parameter<bool> p_imuPose = { "imuPose", false, *this };                          ///< If set to true, every frame gets the IMU orientation interpolated at its timestamp as pose
+		Parameter<double> p_imuPoseTolerance = { "imuPoseTolerance", 20.0, *this };       ///< Time in ms a frame may be newer than the latest IMU sample and still use its orientation
+		Parameter<bool> p_analyticGeometry = { "analyticGeometry", true, *this };         ///< If set to true, the frame geometry is computed from the probe information, image-based detection is only used without it
+		Parameter<bool> p_validateGeometry = { "validateGeometry", false, *this };        ///< If set to true, the analytic frame geometry is checked against image-based detection after every change of the imaging parameters
+		Parameter<bool> p_geometryCache = { "geometryCache", true, *this };                ///< If set to true, detected frame geometries are stored on disk and reused for known configurations, applied on open
+		Parameter<std::string> p_geometryCachePath = { "geometryCachePath", "", *this };    ///< File of the geometry cache, the application data directory if empty
+		Parameter<int> p_queueCapacity = { "queueCapacity", 50, *this };                   ///< Maximum number of frames waiting for the processing thread, applied on start
+		Parameter<int> p_queuePolicy = { "queuePolicy", 0, *this };                        ///< Frames dropped if the queue is full (0: oldest, 1: newest, 2: all but the latest, 3: block the SDK thread up to queueBlockTimeout), see ClariusDropPolicy, applied on start
+		Parameter<int> p_queueBlockTimeout = { "queueBlockTimeout", 50, *this };           ///< Maximum time in ms the SDK thread waits for space with the blocking policy, applied on start
+		Parameter<bool> p_spinWakeup = { "spinWakeup", false, *this };                     ///< If set to true, the processing thread polls for new frames for spinBudget before it sleeps, lowering latency at the cost of CPU time
+		Parameter<int> p_spinBudget = { "spinBudget", 500, *this };                        ///< Time in microseconds the processing thread polls for new frames if spinWakeup is set
+		Parameter<int> p_processingThreads = { "processingThreads", 1, *this };            ///< Number of threads processing frames concurrently after the queue, frames are still emitted in device timestamp order, applied on start
+		Parameter<bool> p_cropToSector = { "cropToSector", false, *this };                  ///< If set to true, frames are cropped to the bounding box of the field of view once the frame geometry is known, with geometry and pose adjusted accordingly
+		Parameter<bool> p_frameViews = { "frameViews", false, *this };                      ///< If set to true, every frame gets a ClariusFrame component with the frame as received and lazily computed gray, sector and preview versions
+		Parameter<bool> p_perFrameMetadata = { "perFrameMetadata", true, *this };          ///< If set to true, every frame gets its own copy of the ultrasound and frame geometry metadata in addition to the shared ClariusFrameMetadata
 
 		Signal<int> buttonPressed;
 
+		/// Emitted on the SDK thread for every pre-scan-converted frame, connected slots must not block
+		/// The frame is shared by all receivers, which may keep a reference to its data but must not take it over.
+		Signal<std::shared_ptr<const ClariusRawFrame>> rawFrameArrived;
+
+		/// Emitted on the SDK thread for every spectral (M-mode / PW Doppler) block, connected slots must not block
+		/// The block is shared by all receivers, which may keep a reference to its data but must not take it over.
+		Signal<std::shared_ptr<const ClariusSpectralBlock>> spectralBlockArrived;
+
+		/// Emitted for every separately sent overlay if p_separateOverlays is set, connected slots must not block
+		/// The overlay is shared by all receivers and must not be modified.
+		Signal<std::shared_ptr<const ClariusOverlayFrame>> overlayArrived;
+
+		/// Emitted on the SDK thread for every frame right before it is queued for processing, connected slots must not block
+		/// The image is shared with the frame emitted by this stream and must not be modified.
+		Signal<const ClariusStreamFrame&> frameArrived;
+
+		/// Emitted on the IMU delivery thread for every batch of standalone IMU samples, see p_imuBatchSize
+		Signal<std::shared_ptr<const std::vector<ClariusImuSample>>> imuSamplesArrived;
+
 		static ClariusStream* m_singletonStreamInstance;    ///< This is to prevent multiple instances
 		/// Process image callback 
 		void onImageArrived(std::unique_ptr<MemImage> mem, unsigned long long imgTm, std::unique_ptr<IMURawMetadata> imuMetadata);
@@ -80,8 +190,27 @@ namespace ImFusion
 		std::optional<WorkContinuation> doWork() override { return std::nullopt; }
 
 	private:
-		void clearBuffer();
+		/// Updates the frame geometry and queues the image for processing, calls must be serialized
+		void handleImage(std::unique_ptr<TypedImage<unsigned char>> img,
+						 unsigned long long timestamp,
+						 std::unique_ptr<IMURawMetadata> imu,
+						 const TypedImage<unsigned char>* knownMask,
+						 const ClariusImageInfo* info);
+
+		/// Sets m_geometry from the probe information if available, from image-based detection otherwise
+		void updateGeometry(const TypedImage<unsigned char>& img, const TypedImage<unsigned char>* knownMask, const ClariusImageInfo* info);
+
+		/// Requests the image-based detection when the mask changes and picks up its result
+		void detectGeometry(const TypedImage<unsigned char>& img, const TypedImage<unsigned char>* knownMask, const ClariusImageInfo* info);
+
+		/// Processing stages between frame queue and signalNewData, e.g. gray conversion, may run for several frames at once
+		void processFrame(ImageStreamData& isd);
+
+		/// Scan converts 8-bit envelope or RF line data on the host and hands the result to handleImage()
+		void scanConvert(const ClariusRawFrame& frame);
+
 		ClariusApi* m_api;
+		std::unique_ptr<ClariusApi> m_ownedApi;    ///< Backend other than the Cast SDK singleton, if any
 
 		struct Impl;
 		std::unique_ptr<Impl> m_pimpl;
@@ -91,11 +220,18 @@ namespace ImFusion
 		bool m_isRunning = false;        ///< True if stream is started
 
 		double m_measuredDepth = 0.0;
-		std::unique_ptr<US::FrameGeometry> m_geometry;
+		std::shared_ptr<const US::FrameGeometry> m_geometry;            ///< Geometry attached to the frames, null if not known yet
+		std::shared_ptr<const US::FrameGeometry> m_detectedGeometry;    ///< Latest geometry detected for the current mask, shared with the detector
+		std::shared_ptr<const US::FrameGeometry> m_analyticGeometry;    ///< Geometry computed from the probe information for the current imaging parameters
+		unsigned int m_analyticGeometryHash = 0;
+		bool m_geometryValidated = false;                                ///< True once the analytic geometry was compared against a detected one
 
 		int m_previousWidth = 0;
 		int m_previousHeight = 0;
 		unsigned int m_previousMaskHash = 0;
 		unsigned int m_lastGeometryDetectionHash = 0;
+		bool m_useAlphaMask = true;                                       ///< True if the alpha channel of the transport format marks the image region
+		std::unique_ptr<TypedImage<unsigned char>> m_accumulatedMask;    ///< Mask accumulated over several frames if there is no alpha channel
+		int m_accumulatedMaskFrames = 0;
 	};
 }
@@ -0,0 +1,306 @@
+// End-to-end benchmark of the ClariusStream pipeline driven by ClariusMockApi
+//
+// Measures sustained frame rate, dropped frames, latency from entering the image callback to the emission of
+// signalNewData, and CPU time per frame over a matrix of output sizes, transport formats, frame rates and
+// p_convertToGray, with the processing thread either parking or spinning when idle (p_spinWakeup). Results are
+// written as JSON, to stdout or to the file given with --output. With --processing-threads, frames are processed by
+// the given number of threads (p_processingThreads), and frames emitted out of order are counted. --no-gray-ingest
+// converts frames to gray after the queue instead of while copying them from the SDK (p_grayIngest).
+//
+// Usage: ClariusStreamBenchmark [--seconds <s>] [--output <file>] [--processing-threads <n>] [--no-gray-ingest] [--quick]
+
+#include "ClariusMockApi.h"
+#include "ClariusStream.h"
+
+#include <ImFusion/Base/TypedImage.h>
+#include <ImFusion/Core/Signal.h>
+#include <ImFusion/GL/SharedImage.h>
+#include <ImFusion/Stream/ImageStreamData.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace ImFusion;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	/// Number of pixels at the start of the first row carrying the frame sequence number
+	const int markerPixels = 3;
+
+	/// Upper bound of frames per run, the entry times are preallocated
+	const size_t maxFrames = 1 << 20;
+
+	struct Config
+	{
+		vec2i resolution;
+		ClariusApi::ImageFormat format;
+		double fps;
+		bool convertToGray;
+		bool spinWakeup;
+		int processingThreads;
+		bool grayIngest;
+	};
+
+	struct Result
+	{
+		size_t sent = 0;
+		size_t delivered = 0;
+		size_t outOfOrder = 0;               ///< Number of frames emitted with a lower sequence number than their predecessor
+		double fps = 0.0;
+		double p50Ms = 0.0;
+		double p99Ms = 0.0;
+		double maxMs = 0.0;
+		double cpuMsPerFrame = 0.0;          ///< Process CPU time per delivered frame, without the synthetic source
+		double sourceCpuMsPerFrame = 0.0;    ///< CPU time per frame of generating the synthetic frames alone
+		ClariusFrameQueueStats queue;         ///< Queue between image callback and processing thread
+		ClariusStream::WakeupStats wakeup;    ///< Latency of waking up the processing thread
+		ClariusWorkerPoolStats processing;    ///< Parallel processing stages, empty with a single processing thread
+	};
+
+	/// Process CPU time in milliseconds
+	double cpuMs() { return 1000.0 * std::clock() / CLOCKS_PER_SEC; }
+
+	/// Writes the sequence number into the first pixels, identical in all colour channels so that it survives gray conversion
+	/// The alpha channel is left untouched, as it defines the image mask.
+	void writeMarker(TypedImage<unsigned char>& img, uint32_t sequence)
+	{
+		const int channels = img.channels();
+		for (int i = 0; i < markerPixels; i++)
+			memset(img.pointer() + i * channels, (sequence >> (8 * i)) & 0xff, std::min(channels, 3));
+	}
+
+	uint32_t readMarker(const TypedImage<unsigned char>& img)
+	{
+		uint32_t sequence = 0;
+		for (int i = 0; i < markerPixels; i++)
+			sequence |= static_cast<uint32_t>(img.pointer()[i * img.channels()]) << (8 * i);
+		return sequence;
+	}
+
+	ClariusMockApi::Settings mockSettings(const Config& config)
+	{
+		ClariusMockApi::Settings settings;
+		settings.fps = config.fps;
+		settings.resolution = config.resolution;
+		settings.jitterMs = 0.5;
+		settings.imuRate = 100.0;
+		return settings;
+	}
+
+	/// CPU time per frame of the synthetic source on its own, subtracted from the pipeline measurement
+	double measureSource(const Config& config, double seconds)
+	{
+		ClariusMockApi api(mockSettings(config));
+		std::atomic<size_t> frames = {0};
+		api.imageCallback = [&frames](std::unique_ptr<TypedImage<unsigned char>>&&, unsigned long long, std::unique_ptr<IMURawMetadata>&&) {
+			frames++;
+		};
+		api.init();
+		api.setImageFormat(config.format);
+		const double cpuStart = cpuMs();
+		api.connect("", 0);
+		std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+		api.disconnect();
+		return frames > 0 ? (cpuMs() - cpuStart) / frames : 0.0;
+	}
+
+	/// Receives the frames emitted by the stream
+	class LatencyProbe : public SignalReceiver
+	{
+	public:
+		LatencyProbe(ClariusStream& stream, const std::vector<Clock::time_point>& entryTimes)
+			: m_entryTimes(entryTimes)
+		{
+			m_latencies.reserve(maxFrames);
+			stream.signalNewData.connect(this, [this](const ImageStreamData& isd) {
+				const auto now = Clock::now();
+				auto images = isd.images2();
+				if (images.empty())
+					return;
+				auto* img = dynamic_cast<const TypedImage<unsigned char>*>(images[0]->mem());
+				if (!img)
+					return;
+				const uint32_t sequence = readMarker(*img);
+				if (m_hasPrevious && sequence < m_previous)
+					m_outOfOrder++;
+				m_previous = sequence;
+				m_hasPrevious = true;
+				if (sequence < m_entryTimes.size() && m_latencies.size() < m_latencies.capacity())
+					m_latencies.push_back(std::chrono::duration<double, std::milli>(now - m_entryTimes[sequence]).count());
+			});
+		}
+
+		std::vector<double> m_latencies;    ///< Only written by one thread at a time, which emits signalNewData
+		size_t m_outOfOrder = 0;
+
+	private:
+		uint32_t m_previous = 0;
+		bool m_hasPrevious = false;
+		const std::vector<Clock::time_point>& m_entryTimes;
+	};
+
+	Result run(const Config& config, double seconds)
+	{
+		Result result;
+		result.sourceCpuMsPerFrame = measureSource(config, std::min(seconds, 1.0));
+
+		auto api = std::make_unique<ClariusMockApi>(mockSettings(config));
+		ClariusMockApi* mock = api.get();
+		std::vector<Clock::time_point> entryTimes(maxFrames);
+		std::atomic<uint32_t> sequence = {0};
+
+		ClariusStream stream(std::move(api), "Benchmark Stream");
+		stream.p_serverAddress = "mock";
+		stream.p_transportFormat = static_cast<int>(config.format);
+		stream.p_convertToGray = config.convertToGray;
+		stream.p_spinWakeup = config.spinWakeup;
+		stream.p_processingThreads = config.processingThreads;
+		stream.p_grayIngest = config.grayIngest;
+
+		// mark every frame on entering the stream's image callback
+		auto streamCallback = mock->imageCallback;
+		mock->imageCallback = [&](std::unique_ptr<TypedImage<unsigned char>>&& img, unsigned long long timestamp, std::unique_ptr<IMURawMetadata>&& imu) {
+			const uint32_t s = sequence++;
+			if (s >= maxFrames)
+				return;
+			entryTimes[s] = Clock::now();
+			writeMarker(*img, s);
+			streamCallback(std::move(img), timestamp, std::move(imu));
+		};
+
+		LatencyProbe probe(stream, entryTimes);
+		if (!stream.open() || !stream.start())
+		{
+			std::cerr << "Could not start the stream" << std::endl;
+			return result;
+		}
+
+		const auto start = Clock::now();
+		const double cpuStart = cpuMs();
+		std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+		stream.stop();
+		const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+		const double cpu = cpuMs() - cpuStart;
+		result.queue = stream.queueStats();
+		result.wakeup = stream.wakeupStats();
+		result.processing = stream.processingStats();
+		stream.close();
+		// let frames still in the processing queue arrive
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+		std::vector<double> latencies = probe.m_latencies;
+		std::sort(latencies.begin(), latencies.end());
+		result.sent = std::min<size_t>(sequence, maxFrames);
+		result.delivered = latencies.size();
+		result.outOfOrder = probe.m_outOfOrder;
+		result.fps = result.delivered / elapsed;
+		if (!latencies.empty())
+		{
+			result.p50Ms = latencies[latencies.size() / 2];
+			result.p99Ms = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+			result.maxMs = latencies.back();
+			result.cpuMsPerFrame = std::max(cpu / result.delivered - result.sourceCpuMsPerFrame, 0.0);
+		}
+		return result;
+	}
+
+	const char* formatName(ClariusApi::ImageFormat format) { return format == ClariusApi::ImageFormat::Gray8 ? "gray8" : "argb"; }
+}
+
+
+int main(int argc, char** argv)
+{
+	double seconds = 3.0;
+	bool quick = false;
+	int processingThreads = 1;
+	bool grayIngest = true;
+	std::string outputPath;
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		if (arg == "--seconds" && i + 1 < argc)
+			seconds = std::stod(argv[++i]);
+		else if (arg == "--output" && i + 1 < argc)
+			outputPath = argv[++i];
+		else if (arg == "--processing-threads" && i + 1 < argc)
+			processingThreads = std::max(std::stoi(argv[++i]), 1);
+		else if (arg == "--no-gray-ingest")
+			grayIngest = false;
+		else if (arg == "--quick")
+			quick = true;
+		else
+		{
+			std::cerr << "Usage: " << argv[0] << " [--seconds <s>] [--output <file>] [--processing-threads <n>] [--no-gray-ingest] [--quick]"
+					  << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<vec2i> resolutions = {vec2i(320, 240), vec2i(640, 480), vec2i(1024, 768), vec2i(1280, 960)};
+	std::vector<ClariusApi::ImageFormat> formats = {ClariusApi::ImageFormat::Argb, ClariusApi::ImageFormat::Gray8};
+	std::vector<double> frameRates = {15.0, 30.0, 60.0, 120.0};
+	if (quick)
+	{
+		resolutions = {vec2i(640, 480)};
+		frameRates = {30.0};
+	}
+
+	std::ostringstream json;
+	json << std::fixed << std::setprecision(3);
+	json << "{\n  \"seconds\": " << seconds << ",\n  \"processingThreads\": " << processingThreads
+		 << ",\n  \"grayIngest\": " << (grayIngest ? "true" : "false") << ",\n  \"runs\": [\n";
+	bool first = true;
+	for (const vec2i& resolution : resolutions)
+		for (ClariusApi::ImageFormat format : formats)
+			for (double fps : frameRates)
+				for (bool convertToGray : {false, true})
+					for (bool spinWakeup : {false, true})
+					{
+						const Config config = {resolution, format, fps, convertToGray, spinWakeup, processingThreads, grayIngest};
+						const Result r = run(config, seconds);
+						std::cerr << resolution[0] << "x" << resolution[1] << " " << formatName(format) << " " << fps << " fps"
+								  << (convertToGray ? " gray" : "") << (spinWakeup ? " spin" : "") << ": " << r.fps << " fps, "
+								  << r.sent - r.delivered << " dropped, " << r.outOfOrder << " out of order, p99 " << r.p99Ms << " ms, wakeup p99 " << r.wakeup.p99Us << " us"
+								  << std::endl;
+
+						json << (first ? "" : ",\n") << "    {\"width\": " << resolution[0] << ", \"height\": " << resolution[1]
+							 << ", \"format\": \"" << formatName(format) << "\", \"targetFps\": " << fps
+							 << ", \"convertToGray\": " << (convertToGray ? "true" : "false")
+							 << ", \"spinWakeup\": " << (spinWakeup ? "true" : "false") << ", \"sent\": " << r.sent
+							 << ", \"delivered\": " << r.delivered << ", \"outOfOrder\": " << r.outOfOrder << ", \"dropped\": " << r.sent - r.delivered << ", \"fps\": " << r.fps
+							 << ", \"latencyP50Ms\": " << r.p50Ms << ", \"latencyP99Ms\": " << r.p99Ms << ", \"latencyMaxMs\": " << r.maxMs
+							 << ", \"cpuMsPerFrame\": " << r.cpuMsPerFrame << ", \"sourceCpuMsPerFrame\": " << r.sourceCpuMsPerFrame
+							 << ", \"queueHighWater\": " << r.queue.highWater
+							 << ", \"queueDropped\": " << r.queue.droppedOldest + r.queue.droppedNewest + r.queue.superseded
+							 << ", \"wakeupP50Us\": " << r.wakeup.p50Us << ", \"wakeupP99Us\": " << r.wakeup.p99Us
+							 << ", \"wakeupMaxUs\": " << r.wakeup.maxUs << ", \"wakeupNotifications\": " << r.wakeup.notifications
+							 << ", \"reorderWaitMeanMs\": " << r.processing.meanReorderWaitMs << ", \"reorderWaitMaxMs\": " << r.processing.maxReorderWaitMs << "}";
+						first = false;
+					}
+	json << "\n  ]\n}\n";
+
+	if (outputPath.empty())
+		std::cout << json.str();
+	else
+	{
+		std::ofstream file(outputPath);
+		file << json.str();
+		if (!file)
+		{
+			std::cerr << "Could not write " << outputPath << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -1,5 +1,9 @@
 #include "ClariusStreamIoAlgorithm.h"
 
+#include "ClariusOverlayStream.h"
+#include "ClariusPreviewStream.h"
+#include "ClariusRawStream.h"
+#include "ClariusSpectralStream.h"
 #include "ClariusStream.h"
 
 #include <ImFusion/Core/Log.h>
@@ -46,6 +50,18 @@ namespace ImFusion
 
 		CreateStreamIoAlgorithm<ClariusStream, false, false>::compute();
 
+		if (!m_fail && m_stream && p_rawStream)
+			m_rawStream = std::make_unique<ClariusRawStream>(m_stream);
+		if (!m_fail && m_stream && p_spectralStream)
+			m_spectralStream = std::make_unique<ClariusSpectralStream>(m_stream);
+		if (!m_fail && m_stream && p_overlayStream)
+		{
+			m_stream->p_separateOverlays = true;
+			m_overlayStream = std::make_unique<ClariusOverlayStream>(m_stream);
+		}
+		if (!m_fail && m_stream && p_previewStream)
+			m_previewStream = std::make_unique<ClariusPreviewStream>(m_stream);
+
 		if (m_fail || m_stream->p_serverAddress.value().empty())
 			return;    // open needs to be called later when IP is known
 
@@ -55,4 +71,18 @@ namespace ImFusion
 			return;
 		}
 	}
+
+	OwningDataList ClariusStreamIoAlgorithm::takeOutput()
+	{
+		OwningDataList output = CreateStreamIoAlgorithm<ClariusStream, false, false>::takeOutput();
+		if (m_rawStream)
+			output.add(std::move(m_rawStream));
+		if (m_spectralStream)
+			output.add(std::move(m_spectralStream));
+		if (m_overlayStream)
+			output.add(std::move(m_overlayStream));
+		if (m_previewStream)
+			output.add(std::move(m_previewStream));
+		return output;
+	}
 }
@@ -9,6 +9,10 @@
 namespace ImFusion
 {
 	class ClariusStream;
+	class ClariusOverlayStream;
+	class ClariusPreviewStream;
+	class ClariusRawStream;
+	class ClariusSpectralStream;
 
 	/** \brief	IO Algorithm for creating a Clarius ultrasound stream
 	 *	\author	Oliver Zettinig
@@ -21,5 +25,19 @@ namespace ImFusion
 		static bool createCompatible(const DataList& data, Algorithm** a = nullptr);
 
 		void compute() override;
+
+		/// Returns the Clarius stream and, if requested, the associated raw data, spectral, overlay and preview streams
+		OwningDataList takeOutput() override;
+
+		Parameter<bool> p_rawStream = { "rawStream", false, *this };              ///< If set to true, an additional stream with the pre-scan-converted frames is created
+		Parameter<bool> p_spectralStream = { "spectralStream", false, *this };    ///< If set to true, an additional stream with the M-mode / PW Doppler spectra is created
+		Parameter<bool> p_overlayStream = { "overlayStream", false, *this };      ///< If set to true, colour overlays are sent separately and provided by an additional stream
+		Parameter<bool> p_previewStream = { "previewStream", false, *this };      ///< If set to true, an additional stream with downsampled grayscale frames is created
+
+	private:
+		std::unique_ptr<ClariusRawStream> m_rawStream;
+		std::unique_ptr<ClariusSpectralStream> m_spectralStream;
+		std::unique_ptr<ClariusOverlayStream> m_overlayStream;
+		std::unique_ptr<ClariusPreviewStream> m_previewStream;
 	};
 }